@@ -1,7 +1,11 @@
 #ifndef BUDDHA_HPP
 #define BUDDHA_HPP
 
+#include <mutex>
+
 #include "multibrot.hpp"
+#include "histogram.hpp"
+#include "random.hpp"
 
 /*
  *
@@ -9,34 +13,108 @@
  *
  */
 
+enum class Sampler { Uniform, Metropolis, Grid };
+
 struct BuddhaOptions : public MandelOptions {
     bool three_channel;
     std::array<size_t, 3> iter_channel;
     int render_hits;
+    Sampler sampler = Sampler::Uniform;
+    bool shared = false;    // one atomic histogram instead of a shard per worker
+    uint64_t rng_seed = 0;
+    std::array<size_t, 2> range = {0, 0};   // samples [begin, end) instead of render_hits when end > 0
+    double checkpoint = 0;  // seconds between histogram checkpoints, none if 0
+    double budget = 0;      // seconds of sampling before the image is made from what there is, none if 0
     Cconverter color;
 };
 
+// Metropolis chain paused mid-way, it carries on at sample next from its current point p, or with start
+// point tries of the search when it had none yet
+struct Chain {
+    size_t next, last;
+    qcomplex p;
+    size_t tries;
+};
+
+// what a histogram file records before its counters, merged and resumed files must agree on it
+struct HistogramInfo {
+    uint64_t width, height;
+    long double tl[2], tl_lo[2], width_c;
+    long double n[2], z_seed[2];
+    uint64_t iter_channel[3], order_channel[3];
+    uint64_t sampler;
+    uint64_t seed, begin, end, hits;
+    std::vector<Chain> chains;
+};
+
 class BuddhabrotBase : public FractalThread {
     public:
         BuddhabrotBase(const BuddhaOptions& fOpts) 
-            : FractalThread(fOpts), n(fOpts.n), z_seed(fOpts.c),
-            three_channel(fOpts.three_channel), render_hits(fOpts.render_hits),
+            : FractalThread(fOpts), n(fOpts.n), exponent(fOpts.exponent), z_seed(fOpts.c),
+            three_channel(fOpts.three_channel), render_hits(fOpts.render_hits), sampler(fOpts.sampler),
+            shared(fOpts.shared), rng_seed(fOpts.rng_seed), rng(fOpts.rng_seed), range(fOpts.range),
+            checkpoint(fOpts.checkpoint), budget(fOpts.budget),
             color(fOpts.color), iter_channel(fOpts.iter_channel)
             { sortChannel(iter_channel, order_channel); }
         void run();
+        void resume(const std::string& path);
+        void merge(const std::vector<std::string>& files);
+
+        static constexpr size_t chain_steps = 1 << 16;  // samples of a Metropolis chain, ranges hold whole chains
+        static constexpr size_t chain_tries = 16*chain_steps;  // start points a chain tries before giving up on the view
 
     protected:
-        inline void addToMap(Cmap& map, const std::vector<complex>& orbit, size_t it);
+        // the Buddhabrot fills whole histograms instead of image tiles
+        void thread(Emap& data, const Tile& tile) { }
+        virtual void sample(Histogram& hist) = 0;
+        virtual void prepare() = 0;
+        inline size_t channel(const size_t& it) const;
+        template <typename T, int N>
+        bool escapes(Complex<T> z, const Complex<T>& c, size_t& it) const;
+        template <typename T, int N>
+        int splat(Histogram& hist, Complex<T> z, const Complex<T>& c, const size_t& it) const;
+        template <typename T, int N, typename F>
+        void orbits(Histogram& hist, const bool& zspace, F point);
+        bool claim(size_t& first, size_t& last, const size_t& chunk);
+        bool takeChain(Chain& chain);
+        size_t sampled() const;
+        HistogramInfo info() const;
+        void writeHistogram(const std::string& path, const Histogram& hist) const;
+        HistogramInfo readHistogram(const std::string& path, Histogram& hist) const;
+        template <typename T>
+        Complex<T> disk(const size_t& i, const uint64_t& stream = 0) const;
+        template <typename T, int N>
+        void metropolis(Histogram& hist, const bool& zspace);
+        template <typename T, int N>
+        void importance(const bool& zspace);
+        template <typename T, int N>
+        void stratified(Histogram& hist, const bool& zspace);
 
         const complex n;
+        const int exponent;
         const complex z_seed;
         const bool three_channel;
         const int render_hits;
+        const Sampler sampler;
+        const bool shared;
+        uint64_t rng_seed;
+        Philox rng;
+        std::array<size_t, 2> range;
+        const double checkpoint;
+        const double budget;
+        std::string resume_file;
+        std::atomic<bool> pause;
+        static constexpr size_t chunk = 256;
         Cconverter color;
         std::array<size_t, 3>  iter_channel;
         std::array<size_t, 3>  order_channel = {0,1,2};
-        std::vector<Cmap> v_map;
+        std::vector<Histogram> v_map;
         std::atomic_int total_hits;
+        std::vector<uint32_t> cells;    // active cells of the importance grid
+        std::atomic<size_t> next_sample;
+        std::atomic<size_t> completed;  // samples whose orbits are all splatted
+        std::vector<Chain> chains;      // paused Metropolis chains, taken before new ones are claimed
+        std::mutex chain_lock;
 };
 
 class BuddhabrotCspace : public BuddhabrotBase {
@@ -45,7 +123,9 @@ class BuddhabrotCspace : public BuddhabrotBase {
             : BuddhabrotBase(fOpts) { }
 
     private:
-        void thread(Cmap& map, const Vpoint& ends);
+        void sample(Histogram& hist);
+        void prepare();
+        template <typename T, int N> void kernel(Histogram& hist);
 };
 
 class BuddhabrotZspace : public BuddhabrotBase {
@@ -54,7 +134,9 @@ class BuddhabrotZspace : public BuddhabrotBase {
             : BuddhabrotBase(fOpts) { }
 
     private:
-        void thread(Cmap& map, const Vpoint& ends);
+        void sample(Histogram& hist);
+        void prepare();
+        template <typename T, int N> void kernel(Histogram& hist);
 };
 
 #endif
\ No newline at end of file
@@ -12,29 +12,31 @@
 class BurningShipCspace : public FractalThread {
     public:
         BurningShipCspace(const MandelOptions& fOpts) 
-            : FractalThread(fOpts), n(fOpts.n), z_seed(fOpts.c),
-            color(fOpts.color) { base_color = fOpts.base_color; }
+            : FractalThread(fOpts), n(fOpts.n), exponent(fOpts.exponent), z_seed(fOpts.c)
+            { base_color = fOpts.base_color; palette = fOpts.color; flip = true; }
 
     private:
-        void thread(Cmap& map, const Vpoint& ends);
+        void thread(Emap& data, const Tile& tile);
+        template <typename T, int N> void kernel(Emap& data, const Tile& tile);
 
         const complex n;
+        const int exponent;
         const complex z_seed;
-        const Cfunction color;
 };
 
 class BurningShipZspace : public FractalThread {
     public:
         BurningShipZspace(const MandelOptions& fOpts) 
-            : FractalThread(fOpts), n(fOpts.n), c(fOpts.c),
-            color(fOpts.color) { base_color = fOpts.base_color; }
+            : FractalThread(fOpts), n(fOpts.n), exponent(fOpts.exponent), c(fOpts.c)
+            { base_color = fOpts.base_color; palette = fOpts.color; flip = true; }
 
     private:
-        void thread(Cmap& map, const Vpoint& ends);
+        void thread(Emap& data, const Tile& tile);
+        template <typename T, int N> void kernel(Emap& data, const Tile& tile);
 
         const complex n;
+        const int exponent;
         const complex c;
-        const Cfunction color;
 };
 
 #endif
\ No newline at end of file
@@ -2,6 +2,10 @@
 #define COLOR_HPP
 
 #include "utils.hpp"
+#include "framebuffer.hpp"
+#include "escape.hpp"
+
+#include <variant>
 
 #define R 0
 #define G 1
@@ -13,10 +17,58 @@
 #define GREEN ((Pcolor) {0x00,0xFF,0x00})
 #define BLUE  ((Pcolor) {0x00,0x00,0xFF})
 
-using Pcolor = std::array<long, 3>;
-using Cmap = std::vector<std::vector<Pcolor>>;
-using Cfunction = std::function<Pcolor(const size_t&, const complex&)>;
-using Cconverter = std::function<void(Cmap& map)>;
+// concrete palettes, Cfunction picks one when the op file is read so coloring a row is a single dispatch
+namespace Palette {
+    // gradient of the Smooth and Default palettes, cyclic in the smooth iteration count
+    struct Smooth {
+        Smooth(const std::vector<Pcolor>& colors, const long double& p);
+
+        float index(const uint32_t& n, const float& r) const;
+        void lookup(const float& x, float* c) const;
+        Pcolor operator()(const size_t& n, const long double& r) const;
+
+        std::vector<std::array<float, 3>> table;
+        float inv_lp;   // 1/log p
+        float log_2lp;  // log(2 log p)
+    };
+
+    // one color per Newton root
+    struct Roots {
+        Pcolor operator()(const size_t& n, const long double& root) const;
+
+        std::vector<Pcolor> colors;
+    };
+
+    // root color darkened by the iteration count, the fraction of the value smooths it between iterations
+    struct ShadedRoots {
+        Pcolor operator()(const size_t& n, const long double& root) const;
+
+        std::vector<Pcolor> colors;
+        double shading;
+    };
+}
+
+// color of a sample from its iteration and escape value, see Sample; any other function of the sample
+// still works, through std::function
+class Cfunction {
+    public:
+        using Function = std::function<Pcolor(const size_t&, const long double&)>;
+
+        Cfunction() = default;
+        template <typename F, typename = std::enable_if_t<std::is_invocable_r_v<Pcolor, F, const size_t&, const long double&>>>
+        Cfunction(F f) : kind(Function(std::move(f))) { }
+        Cfunction(const Palette::Smooth& p) : kind(p) { }
+        Cfunction(const Palette::Roots& p) : kind(p) { }
+        Cfunction(const Palette::ShadedRoots& p) : kind(p) { }
+
+        Pcolor operator()(const size_t& n, const long double& value) const;
+        void row(const Sample* in, const size_t& pixels, const size_t& samples, const Pcolor& base, Cmap::Pixel* out) const;
+
+    private:
+        std::variant<Function, Palette::Smooth, Palette::Roots, Palette::ShadedRoots> kind;
+};
+
+using Cconverter = std::function<void(const Hmap& hist, Cmap& map)>;
 
 namespace ColorGen {
     using Vcolor = std::vector<Pcolor>;
@@ -27,9 +79,10 @@ namespace ColorGen {
 
     Cfunction generateSmooth(const VCpair& colors_pair, const long double& p);
     Cfunction generateDefault(const size_t& type, const size_t& size);
-    Cfunction generateRootsSimple(const Vcolor& color, const Vcomplex& roots);
+    Cfunction generateRootsSimple(const Vcolor& color);
+    Cfunction generateRootsShaded(const Vcolor& color, const double& shading);
 
-    void threeChannel(Cmap& map);
+    void threeChannel(const Hmap& hist, Cmap& map);
     Cconverter generateSmooth(const VCpair& colors_pair);
     Cconverter generateDefault(const size_t& type);
     Cconverter generateThreeChannel(const double& threshold);
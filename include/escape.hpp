@@ -0,0 +1,48 @@
+#ifndef ESCAPE_HPP
+#define ESCAPE_HPP
+
+#include <cstdint>
+
+#include "utils.hpp"
+
+/*
+ *
+ * Per-sample escape data
+ *
+ */
+
+// what a kernel leaves behind for the coloring pass
+struct Sample {
+    static constexpr uint32_t interior = std::numeric_limits<uint32_t>::max();
+
+    uint32_t iter;  // escape iteration, interior if it never escaped/converged
+    float value;    // |z|^2 at escape, the root index for Newton
+};
+
+// samples of every pixel, row major, samples() consecutive entries per pixel; a strip of the image starts
+// at image row top and is indexed with image rows
+class Emap {
+    public:
+        Emap() = default;
+        Emap(const size_t& width, const size_t& height, const size_t& samples, const size_t& top = 0)
+            : w(width), h(height), s(samples), top(top), buffer(width*height*samples, {Sample::interior, 0}) { }
+
+        size_t width() const { return w; }
+        size_t height() const { return h; }
+        size_t samples() const { return s; }
+
+        Sample* operator()(const size_t& row, const size_t& col) { return buffer.data() + ((row - top)*w + col)*s; }
+        const Sample* operator()(const size_t& row, const size_t& col) const { return buffer.data() + ((row - top)*w + col)*s; }
+
+        void save(const std::string& path) const;
+        void load(const std::string& path);
+
+    private:
+        size_t w = 0;
+        size_t h = 0;
+        size_t s = 0;
+        size_t top = 0;
+        std::vector<Sample> buffer;
+};
+
+#endif
@@ -4,46 +4,130 @@
 #include <thread>
 #include <atomic>
 #include <random>
+#include <deque>
+#ifdef USE_MAGICK
 #include <Magick++.h>
+#endif
 
 #include "utils.hpp"
 #include "color.hpp"
-
-#define Nthreads std::thread::hardware_concurrency()
+#include "scheduler.hpp"
+#include "simd.hpp"
+#include "escape.hpp"
+#include "png.hpp"
 
 struct FThreadOpts {
     complex tl_corner;
+    complex tl_lo = {0,0};  // rounding error of tl_corner, only seen by quad kernels
     long double x_size;
     Vpoint size;
     size_t max_iterations;
     std::string name;
     std::string op_file;
     int ssaa;
+    size_t tile = 32;
+    Simd::Mode simd = Simd::Mode::Off;
+    Precision precision = Precision::Long;
+    int subdivide = 0;  // escape-time only, 1 fills interior rectangles, 2 any rectangle of one dwell
+    long adaptive = -1; // color threshold of adaptive supersampling, off when negative
+    Encoder encoder = Encoder::Png;
+    size_t tiled = 0;       // side of the image tiles of an out-of-core render, off when 0
+    bool pyramid = false;   // tiled renders also write the lower Deep Zoom levels
+    size_t frames = 0;      // zoom animation from this view to zoom_to, off when 0
+    complex zoom_to = {0,0};    // center of the last frame
+    complex zoom_to_lo = {0,0};
+    long double zoom_size = 0;  // x_size of the last frame
 };
 
 class FractalThread : protected FThreadOpts {
     public:
         void setOpFile(const std::string& op_file);
+        const std::string& getName() const { return name; }
         void setDimensions(complex tl_corner, long double x_size, Vpoint size);
         virtual void run();
         void printMap();
+        void openImage();
         void drawImage();
+        void drawImage(TaskGroup& encoding);
+        void closeImage();
+        void keepEscape() { keep_escape = true; }
+        void saveEscape(const std::string& path) const;
+        void recolor(const std::string& path);
+        virtual void resume(const std::string& path)
+            { throw std::invalid_argument("Only Buddhabrot renders can be resumed"); }
+        virtual void merge(const std::vector<std::string>& files)
+            { throw std::invalid_argument("Only Buddhabrot histograms can be merged"); }
 
     protected:
         FractalThread(const FThreadOpts& fOpts) : FThreadOpts(fOpts)
             { setDimensions(tl_corner, x_size, size); }
-        virtual void thread(Cmap& map, const Vpoint& ends) = 0;
+        virtual void thread(Emap& data, const Tile& tile) = 0;
+        virtual void render();
+        void renderTiles();
+        Cmap reduce(const size_t& level, const Vpoint& t);
+        void renderTile(const Vpoint& t);
+        void writeTile(const Cmap& image, const size_t& level, const Vpoint& t) const;
+        void animate();
+        bool predicted(const Tile& t) const;
         void init();
-        complex index2point(const Vpoint& loc) const;
+        bool keepsImage() const;
+        bool streamed() const;
+        void submitTiles(TaskGroup& group, Emap& data, const std::vector<Tile>& tiles);
+        void iterate();
+        void iterateStrips();
+        void report(const TaskGroup& group, const size_t& tiles) const;
+        void border(Emap& data, const Tile& r);
+        void split(Emap& data, const Tile& r, TaskGroup& group);
+        void refine();
+        virtual bool differs(const Sample& a, const Sample& b, const Pcolor& ca, const Pcolor& cb) const;
+        void colorize(const Vpoint& rows);
+        void colorize() { colorize({0, size[Y]}); }
+        complex index2offset(const Vpoint& loc) const;
+        template <typename T = long double>
+        Complex<T> index2point(const Vpoint& loc) const;
+        Precision resolvePrecision() const;
         bool point2index(const complex& z, Vpoint& loc) const;
+        void vectorThread(Emap& data, const Tile& tile, const complex& seed, const bool& zspace, const bool& burning);
         
         Cmap map;
+        Emap escape;
         complex br_corner;
         complex c_vector;
         Vpoint size1;
+        Precision scalar;
         Pcolor base_color = BLACK;
+        Cfunction palette;
+        bool flip = false;  // image rows bottom up, for the Burning Ship
+        bool perturbed = false;     // pixels are perturbations of quad reference orbits, scalar and simd are not used
+        std::atomic<size_t> filled = 0;
+        size_t refined = 0;
+        Vpoint subsamples;  // range of ssaa_dz the kernels compute
         bool has_run = false;
+        bool keep_escape = false;   // the whole escape buffer outlives the render, for --save-escape
         std::vector<complex> ssaa_dz;
+        std::string image_name;     // name, or name_i when that image already exists
+        std::unique_ptr<PngWriter> png;
+        static constexpr size_t band = 16;  // rows colored and compressed together
+        Vpoint origin = {0,0};      // image pixel of the first buffer pixel, size is the tile's in tiled renders
+        size_t top_level = 0;       // full resolution Deep Zoom level
+        size_t tiles_done = 0;
+        bool full = false;          // interior without holes (Mandelbrot and Julia sets of whole n >= 2), a border of interior samples encloses interior only
+        Emap previous;              // escape data of the previous frame of a zoom, and its view
+        qcomplex previous_tl;
+        complex previous_step;
 };
 
+template <typename T>
+Complex<T> FractalThread::index2point(const Vpoint& loc) const
+{
+    complex d = index2offset(loc);
+
+    if constexpr (std::is_same_v<T, quad>) {
+        return qcomplex(tl_corner) + qcomplex(tl_lo) + qcomplex(d);
+    }
+    else {
+        return Complex<T>(tl_corner + d);
+    }
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,87 @@
+#ifndef FRAMEBUFFER_HPP
+#define FRAMEBUFFER_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <span>
+
+#include "utils.hpp"
+
+/*
+ *
+ * Contiguous RGB framebuffer
+ *
+ */
+
+using Pcolor = std::array<long, 3>;
+
+// one pixel of T channels, assignable from the long based Pcolor the color functions work with
+template <typename T>
+struct Channels : public std::array<T, 3> {
+    Channels& operator=(const Pcolor& c)
+    {
+        for (size_t i = 0; i < 3; ++i) {
+            (*this)[i] = static_cast<T>(c[i]);
+        }
+
+        return *this;
+    }
+
+    operator Pcolor() const { return {(*this)[0], (*this)[1], (*this)[2]}; }
+};
+
+// single allocation, rows of width pixels every stride pixels, 64 byte aligned
+template <typename T>
+class Framebuffer {
+    public:
+        using Pixel = Channels<T>;
+
+        Framebuffer() = default;
+        Framebuffer(const size_t& width, const size_t& height, const Pcolor& fill = {0,0,0})
+            : w(width), h(height), s(width), buffer(allocate(width*height))
+            { this->fill(fill); }
+
+        size_t width() const { return w; }
+        size_t height() const { return h; }
+        size_t stride() const { return s; }
+        size_t bytes() const { return h*s*sizeof(Pixel); }
+
+        Pixel* operator[](const size_t& row) { return buffer.get() + row*s; }
+        const Pixel* operator[](const size_t& row) const { return buffer.get() + row*s; }
+        T* data() { return reinterpret_cast<T*>(buffer.get()); }
+        const T* data() const { return reinterpret_cast<const T*>(buffer.get()); }
+
+        void fill(const Pcolor& color)
+        {
+            Pixel p;
+            p = color;
+            std::fill(buffer.get(), buffer.get() + h*s, p);
+        }
+
+    private:
+        struct Free {
+            void operator()(Pixel* p) const { std::free(p); }
+        };
+
+        static Pixel* allocate(const size_t& n)
+        {
+            size_t bytes = ((n*sizeof(Pixel) + 63)/64)*64;
+            Pixel* p = static_cast<Pixel*>(std::aligned_alloc(64, std::max<size_t>(bytes, 64)));
+
+            if (p == nullptr) throw std::bad_alloc();
+
+            return p;
+        }
+
+        size_t w = 0;
+        size_t h = 0;
+        size_t s = 0;
+        std::unique_ptr<Pixel[], Free> buffer;
+};
+
+static_assert(sizeof(Channels<uint8_t>) == 3, "8 bit pixels must pack to RGB24");
+
+using Cmap = Framebuffer<uint8_t>;
+using Hmap = Framebuffer<uint32_t>;
+
+#endif
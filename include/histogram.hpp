@@ -0,0 +1,57 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+
+#include "framebuffer.hpp"
+
+/*
+ *
+ * Orbit histogram
+ *
+ */
+
+// three 32 bit counters per pixel in 8x8 pixel tiles, scattered orbit points touch fewer cache lines;
+// a shared histogram is incremented atomically by every worker, otherwise each worker owns a shard
+class Histogram {
+    public:
+        static constexpr size_t side = 8;
+
+        Histogram() = default;
+        Histogram(const size_t& width, const size_t& height, const bool& shared = false);
+
+        size_t width() const { return w; }
+        size_t height() const { return h; }
+        bool shared() const { return atomic; }
+
+        inline void add(const size_t& row, const size_t& col, const size_t& ch, const uint32_t& k = 1)
+        {
+            uint32_t& c = counters[index(row, col) + ch];
+
+            if (atomic) std::atomic_ref<uint32_t>(c).fetch_add(k, std::memory_order_relaxed);
+            else c += k;
+        }
+
+        uint32_t get(const size_t& row, const size_t& col, const size_t& ch) const { return counters[index(row, col) + ch]; }
+
+        void reduce(const std::vector<Histogram>& shards);
+        void copyTo(Hmap& map) const;
+        void write(std::ostream& fp) const;
+        void read(std::istream& fp);
+
+    private:
+        inline size_t index(const size_t& row, const size_t& col) const
+        {
+            return 3*(((row/side)*tiles + col/side)*side*side + (row%side)*side + col%side);
+        }
+
+        size_t w = 0;
+        size_t h = 0;
+        size_t tiles = 0;
+        bool atomic = false;
+        std::vector<uint32_t> counters;
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define MULTIBROT_HPP
 
 #include "fractal.hpp"
+#include "perturbation.hpp"
 
 /*
  *
@@ -12,7 +13,9 @@
 
 struct MandelOptions : public FThreadOpts {
     complex n = 2;
+    int exponent = 2;
     complex c = {0,0};
+    bool deep = false;
     Pcolor base_color = BLACK;
     Cfunction color;
 };
@@ -20,27 +23,42 @@ struct MandelOptions : public FThreadOpts {
 class MandelbrotCspace : public FractalThread {
     public:
         MandelbrotCspace(const MandelOptions& fOpts)
-            : FractalThread(fOpts), n(fOpts.n), z_seed(fOpts.c),
-            color(fOpts.color) { base_color = fOpts.base_color; }
+            : FractalThread(fOpts), n(fOpts.n), exponent(fOpts.exponent), z_seed(fOpts.c),
+            deep(fOpts.deep) { base_color = fOpts.base_color; palette = fOpts.color; full = !deep && exponent >= 2; perturbed = deep; }
+
     private:
-        void thread(Cmap& map, const Vpoint& ends);
+        void thread(Emap& data, const Tile& tile);
+        void render();
+        template <typename T, int N> void kernel(Emap& data, const Tile& tile);
+        void reference(const complex& offset, const long double& radius);
+        void reference(const Vpoint& loc, const long double& radius);
+        bool perturb(Emap& data, const Vpoint& loc);
+        void rebase();
 
         const complex n;
+        const int exponent;
         const complex z_seed;
-        const Cfunction color;
+        const bool deep;
+        ReferenceOrbit orbit;
+        complex ref_offset;
+        ReferenceOrbit center;
+        complex center_offset;
+        qcomplex center_tl;
+        std::vector<char> glitched;
 };
 
 class MandelbrotZspace : public FractalThread {
     public:
         MandelbrotZspace(const MandelOptions& fOpts)
-            : FractalThread(fOpts), n(fOpts.n), c(fOpts.c),
-            color(fOpts.color) { base_color = fOpts.base_color; }
+            : FractalThread(fOpts), n(fOpts.n), exponent(fOpts.exponent), c(fOpts.c)
+            { base_color = fOpts.base_color; palette = fOpts.color; full = exponent >= 2; }
     private:
-        void thread(Cmap& map, const Vpoint& ends);
+        void thread(Emap& data, const Tile& tile);
+        template <typename T, int N> void kernel(Emap& data, const Tile& tile);
 
         const complex n;
+        const int exponent;
         const complex c;
-        const Cfunction color;
 };
 
 #endif
\ No newline at end of file
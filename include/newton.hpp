@@ -15,23 +15,27 @@ struct NewtonOptions : public FThreadOpts{
     long double a;
     ColorGen::Vcolor colors;
     Pcolor base_color = BLACK;
+    double shading = 0;     // darkening per iteration to convergence, flat basins if 0
     Cfunction color;
 };
 
 class NewtonFractal : public FractalThread {
     public:
         NewtonFractal(const NewtonOptions& fOpts)
-            : FractalThread(fOpts), roots(fOpts.roots), rad_2(fOpts.rad_2),
-            c_a(fOpts.a, 0), color(fOpts.color) { base_color = fOpts.base_color; }
+            : FractalThread(fOpts), roots(fOpts.roots), coefs(expand(fOpts.roots)), rad_2(fOpts.rad_2),
+            c_a(fOpts.a, 0) { base_color = fOpts.base_color; palette = fOpts.color; }
     private:
-        void thread(Cmap& map, const Vpoint& ends);
-        inline complex rhapson(const complex& z);
-        inline bool checkRoot(const complex& z);
+        void thread(Emap& data, const Tile& tile);
+        template <typename T, int D> void kernel(Emap& data, const Tile& tile);
+        template <typename T, int D> inline Complex<T> step(const Complex<T>& z, const Complex<T>* coefs_t) const;
+        template <typename T> inline size_t nearestRoot(const Complex<T>& z, const std::vector<Complex<T>>& roots_t) const;
+        bool differs(const Sample& a, const Sample& b, const Pcolor& ca, const Pcolor& cb) const;
+        static Vcomplex expand(const Vcomplex& roots);
 
         const Vcomplex roots;
+        const Vcomplex coefs;   // of the monic polynomial with these roots, constant term first
         const long double rad_2;
         const complex c_a;
-        const Cfunction color;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,28 @@
+#ifndef PERTURBATION_HPP
+#define PERTURBATION_HPP
+
+#include "utils.hpp"
+
+/*
+ *
+ * Perturbation theory for deep zooms
+ *
+ */
+
+// high precision orbit of one reference point, pixels iterate a double delta against it
+struct ReferenceOrbit {
+    ReferenceOrbit() = default;
+    ReferenceOrbit(const qcomplex& c, const qcomplex& z_seed, const size_t& max_iterations);
+    void approximate(const long double& radius, const long double& spacing);
+
+    std::vector<Complex<double>> z;
+    std::vector<double> glitch;
+
+    // delta at iteration skip ~ a*dc + b*dc^2 + c*dc^3
+    size_t skip = 0;
+    Complex<double> a = {0,0};
+    Complex<double> b = {0,0};
+    Complex<double> c = {0,0};
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef PNG_HPP
+#define PNG_HPP
+
+#include <fstream>
+#include <mutex>
+#include <map>
+#include <cstdint>
+
+#include "utils.hpp"
+
+/*
+ *
+ * Streaming PNG encoder
+ *
+ */
+
+enum class Encoder { Png, Magick };
+
+// 8 bit RGB PNG written band by band. Every band is filtered and deflated on its own by the thread that
+// hands it in, its first row only with the filters that do not look above, and the compressed bands are
+// appended to the one zlib stream in order, so bands may come from any thread in any order and only the
+// compressed ones wait in memory. A writer destroyed before close() removes its file
+class PngWriter {
+    public:
+        PngWriter(const std::string& path, const size_t& width, const size_t& height, const int& level = 6);
+        ~PngWriter();
+
+        void band(const size_t& first, const size_t& count, const uint8_t* rows, const size_t& stride);
+        bool complete() const { return next_row == height; }
+        void close();
+
+    private:
+        struct Band {
+            std::vector<uint8_t> data;
+            uint32_t adler;
+            size_t raw;
+        };
+
+        void chunk(const char* type, const uint8_t* data, const size_t& size);
+        void flush();
+
+        const std::string path;
+        std::ofstream fp;
+        const size_t width;
+        const size_t height;
+        const int level;
+        std::mutex lock;
+        std::map<size_t, Band> pending;     // compressed bands below a missing one, by first row
+        size_t next_row = 0;
+        uint32_t adler;
+        bool closed = false;
+};
+
+#endif
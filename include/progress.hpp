@@ -0,0 +1,38 @@
+#ifndef PROGRESS_HPP
+#define PROGRESS_HPP
+
+#include <chrono>
+#include <csignal>
+
+#include "utils.hpp"
+
+/*
+ *
+ * Progress of long runs
+ *
+ */
+
+// wall clock, time budget and SIGINT of one run, reported from the thread that waits on the workers.
+// The first SIGINT only asks the run to stop, a second one kills the process
+class Progress {
+    public:
+        Progress(const double& budget = 0);
+        ~Progress();
+
+        double elapsed() const;
+        bool expired() const { return budget > 0 && elapsed() >= budget; }
+        bool cancelled() const { return interrupted != 0; }
+        bool stopping() const { return expired() || cancelled(); }
+        void report(const size_t& samples, const size_t& hits, const double& done);
+        void summary(const size_t& samples, const size_t& hits) const;
+
+    private:
+        static void handler(int sig);
+
+        const double budget;
+        const std::chrono::steady_clock::time_point start;
+        void (*previous)(int);
+        static volatile std::sig_atomic_t interrupted;
+};
+
+#endif
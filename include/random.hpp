@@ -0,0 +1,50 @@
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+#include <cstdint>
+
+#include "utils.hpp"
+
+/*
+ *
+ * Counter-based random numbers
+ *
+ */
+
+// Philox4x32-10 (Salmon et al., 2011), a keyed bijection of a 128 bit counter: the numbers of
+// counter (a, b) only depend on the seed, so any thread or process can compute any of them
+class Philox {
+    public:
+        using Block = std::array<uint32_t, 4>;
+
+        explicit Philox(const uint64_t& seed = 0)
+            : key{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)} { }
+
+        inline Block operator()(const uint64_t& a, const uint64_t& b = 0) const
+        {
+            Block x = {static_cast<uint32_t>(a), static_cast<uint32_t>(a >> 32),
+                static_cast<uint32_t>(b), static_cast<uint32_t>(b >> 32)};
+            std::array<uint32_t, 2> k = key;
+
+            for (int r = 0; r < 10; ++r) {
+                const uint64_t p0 = static_cast<uint64_t>(0xD2511F53u)*x[0];
+                const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u)*x[2];
+                x = {static_cast<uint32_t>(p1 >> 32) ^ x[1] ^ k[0], static_cast<uint32_t>(p1),
+                    static_cast<uint32_t>(p0 >> 32) ^ x[3] ^ k[1], static_cast<uint32_t>(p0)};
+                k[0] += 0x9E3779B9u;
+                k[1] += 0xBB67AE85u;
+            }
+
+            return x;
+        }
+
+        // [0, 1) with 32 or 53 random bits
+        static inline double unit(const uint32_t& x) { return x*0x1p-32; }
+        static inline double unit(const uint32_t& hi, const uint32_t& lo)
+            { return ((static_cast<uint64_t>(hi) << 21) | (lo >> 11))*0x1p-53; }
+
+    private:
+        std::array<uint32_t, 2> key;
+};
+
+#endif
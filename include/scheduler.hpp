@@ -0,0 +1,84 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <exception>
+
+#include "utils.hpp"
+
+#define Nthreads std::max(1u, std::thread::hardware_concurrency())
+
+/*
+ *
+ * Work-stealing thread pool
+ *
+ */
+
+// rectangle of the image, rows and cols are half-open ranges {begin, end}
+struct Tile {
+    Vpoint rows;
+    Vpoint cols;
+};
+
+using Task = std::function<void()>;
+
+class TaskGroup {
+    public:
+        TaskGroup();
+        double imbalance() const;
+        void add(const TaskGroup& other);
+
+    private:
+        friend class ThreadPool;
+
+        std::atomic<size_t> pending = 0;
+        std::mutex lock;
+        std::condition_variable done;
+        std::exception_ptr error;
+        std::vector<double> busy;
+};
+
+class ThreadPool {
+    public:
+        static ThreadPool& instance();
+        ~ThreadPool();
+
+        size_t size() const { return workers.size(); }
+        void submit(TaskGroup& group, Task task);
+        void submit(TaskGroup& group, Task task, size_t worker);
+        void wait(TaskGroup& group);
+        bool wait(TaskGroup& group, const double& seconds);
+
+    private:
+        struct Job {
+            TaskGroup* group;
+            Task task;
+        };
+
+        struct Queue {
+            std::mutex lock;
+            std::deque<Job> jobs;
+        };
+
+        ThreadPool(size_t n);
+        void work(size_t id);
+        bool pop(size_t id, Job& job);
+        void execute(size_t id, Job& job);
+
+        std::vector<std::thread> workers;
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::mutex sleep_lock;
+        std::condition_variable sleep_cv;
+        std::atomic<size_t> queued = 0;
+        std::atomic<size_t> next = 0;
+        bool stop = false;
+};
+
+std::vector<Tile> splitTiles(const Vpoint& size, const size_t& tile);
+void parallelFor(const size_t& count, const size_t& chunk, const std::function<void(size_t, size_t)>& f);
+
+#endif
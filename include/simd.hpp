@@ -0,0 +1,38 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include "utils.hpp"
+
+/*
+ *
+ * Vectorized escape-time iteration
+ *
+ */
+
+namespace Simd {
+    enum class Mode { Off, Double, Float };
+    enum class Isa { Sse2, Avx2, Avx512 };
+
+    // z -> z^2 + c, or z -> (|re z| + i|im z|)^2 + c for the Burning Ship, one sample per lane
+    struct Escape {
+        const double* zr;
+        const double* zi;
+        const double* cr;
+        const double* ci;
+        size_t count;
+        size_t max_iterations;
+        bool burning;
+
+        // iteration of escape, max_iterations if the sample never escaped
+        size_t* iter;
+        double* fr;
+        double* fi;
+    };
+
+    Isa detect();
+    std::string name(const Isa& isa);
+    size_t lanes(const Mode& mode);
+    void escape(const Escape& job, const Mode& mode);
+}
+
+#endif
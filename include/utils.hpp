@@ -24,20 +24,88 @@
 
 namespace fs = std::filesystem;
 
-using complex = std::complex<long double>;
+using quad = __float128;
+template <typename T>
+using Complex = std::complex<T>;
+using complex = Complex<long double>;
+using qcomplex = Complex<quad>;
 using Vpoint = std::array<size_t, 2>;
 using ComplexF = std::function<complex(const complex&)>;
 using Vcomplex = std::vector<complex>;
-using Imap = std::vector<std::vector<size_t>>;
 
 constexpr complex c_one = {1.0, 0.0};
-constexpr complex c_card = {0.25, 0.0};
 
-inline long double sqrMod(const complex& val)
+enum class Precision { Float, Double, Long, Quad, Auto };
+
+template <typename T>
+inline T sqrMod(const Complex<T>& val)
 {
     return std::real(val)*std::real(val) + std::imag(val)*std::imag(val);
 }
 
+template <typename T>
+inline complex toComplex(const Complex<T>& val)
+{
+    return {static_cast<long double>(std::real(val)), static_cast<long double>(std::imag(val))};
+}
+
+// (|re z|, |im z|), std::abs has no __float128 overload
+template <typename T>
+inline Complex<T> fold(const Complex<T>& val)
+{
+    return {(std::real(val) < 0) ? -std::real(val) : std::real(val), (std::imag(val) < 0) ? -std::imag(val) : std::imag(val)};
+}
+
+// z^N with N known at compile time, squaring instead of going through log/exp
+template <int N, typename T>
+inline Complex<T> ipow(const Complex<T>& z)
+{
+    if constexpr (N == 1) {
+        return z;
+    }
+    else if constexpr (N%2 == 0) {
+        const Complex<T> h = ipow<N/2>(z);
+        return {std::real(h)*std::real(h) - std::imag(h)*std::imag(h), 2*std::real(h)*std::imag(h)};
+    }
+    else {
+        return ipow<N-1>(z)*z;
+    }
+}
+
+// N == 0 is the general, non integer exponent, quad has no complex log/exp so it goes through long double
+template <int N, typename T>
+inline Complex<T> cpow(const Complex<T>& z, const Complex<T>& n)
+{
+    if constexpr (N != 0) return ipow<N>(z);
+    else if constexpr (std::is_same_v<T, quad>) return Complex<T>(std::pow(toComplex(z), toComplex(n)));
+    else return std::pow(z, n);
+}
+
+// calls f with std::integral_constant<int, N> for the specialized exponents, N = 0 otherwise
+template <typename F>
+inline void dispatchExponent(const int& exponent, F&& f)
+{
+    switch (exponent) {
+        case 2: f(std::integral_constant<int, 2>{}); break;
+        case 3: f(std::integral_constant<int, 3>{}); break;
+        case 4: f(std::integral_constant<int, 4>{}); break;
+        case 5: f(std::integral_constant<int, 5>{}); break;
+        default: f(std::integral_constant<int, 0>{}); break;
+    }
+}
+
+// calls f with std::type_identity<T> for the scalar type of the kernel
+template <typename F>
+inline void dispatchPrecision(const Precision& precision, F&& f)
+{
+    switch (precision) {
+        case Precision::Float: f(std::type_identity<float>{}); break;
+        case Precision::Double: f(std::type_identity<double>{}); break;
+        case Precision::Quad: f(std::type_identity<quad>{}); break;
+        default: f(std::type_identity<long double>{}); break;
+    }
+}
+
 inline void sortChannel(std::array<size_t, 3>& iter_channel, std::array<size_t, 3>& order_channel)
 {
     size_t aux;
@@ -71,16 +139,28 @@ inline void sortChannel(std::array<size_t, 3>& iter_channel, std::array<size_t,
     }
 }
 
-inline bool circleCardiod(const complex& val)
+// exact main cardioid and period-2 bulb of z^2 + c, both are interior
+template <typename T>
+inline bool circleCardiod(const Complex<T>& val)
 {
-    if (sqrMod(val + c_card) <= 0.25) return true; // check if inside a large portion of the cardioid
-    else if (sqrMod(val + c_one) <= 0.0625) return true; // check if inside double fixed point
-    
-    // implement cardioid check
+    const T x = std::real(val) - T(0.25);
+    const T y2 = std::imag(val)*std::imag(val);
+    const T q = x*x + y2;
+
+    if (q*(q + x) <= y2/4) return true; // main cardioid
+    else if (sqrMod(val + Complex<T>(c_one)) <= T(0.0625)) return true; // period-2 bulb
 
     return false;
 }
 
+// squared distance under which an orbit is taken to have closed on itself
+template <typename T>
+inline T periodTolerance()
+{
+    if constexpr (std::is_same_v<T, quad>) return static_cast<quad>(1.5e-64L);
+    else return 4096*std::numeric_limits<T>::epsilon()*std::numeric_limits<T>::epsilon();
+}
+
 template <typename T, size_t N>
 std::ostream& operator<<(std::ostream& os, const std::array<T,N>& val)
 {
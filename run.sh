@@ -6,5 +6,5 @@ make
 
 if [ -f "exe" ]; then
     echo -e "Starting run . . .\n\n"
-    time ./exe $1
+    time ./exe "$@"
 fi
\ No newline at end of file
@@ -1,127 +1,729 @@
 #include "buddha.hpp"
 
+#include <bit>
+#include <fstream>
+
+#include "progress.hpp"
+
+// cells of the importance grid over [-2, 2]^2
+static constexpr size_t grid = 256;
+static constexpr long double cell = 4.0L/grid;
+
+// cell with bottom left corner p fully in the cardioid or the period-2 bulb, the cardioid is convex
+// but for the wedge of the cusp, which only cells across the real axis near 1/4 can reach
+static bool cellInterior(const complex& p)
+{
+    const complex corners[4] = {p, p + complex(cell, 0), p + complex(0, cell), p + complex(cell, cell)};
+    int bulb = 0, cardioid = 0;
+
+    if (p.imag() < 0 && p.imag() + cell > 0 && p.real() + cell > 0.24L) return false;
+
+    for (const complex& c : corners) {
+        if (sqrMod(c + c_one) <= 0.0625L) ++bulb;
+        else if (circleCardiod(c)) ++cardioid;
+    }
+
+    return bulb == 4 || cardioid == 4;
+}
+
 void BuddhabrotBase::run()
 {
-    std::vector<std::thread> t_vector;
+    ThreadPool& pool = ThreadPool::instance();
     
     if (has_run) return;
 
     init();
 
     v_map.clear();
-    v_map.reserve(Nthreads);
+    v_map.reserve(pool.size());
     total_hits = 0;
-    for (size_t i = 0; i < Nthreads; ++i) {
-        v_map.push_back(Cmap(size[Y], std::vector<Pcolor>(size[X], BLACK)));
-        t_vector.push_back(std::thread([&]{ this->thread(this->v_map.back(), {0,0}); }));
+    for (size_t i = 0; i < (shared ? 1 : pool.size()); ++i) {
+        v_map.push_back(Histogram(size[X], size[Y], shared));
     }
 
-    for (std::thread& t : t_vector) {
-        t.join();
+    next_sample = range[X];
+    completed = range[X];
+    chains.clear();
+
+    // a checkpoint brings back its counters, seed and the samples already done
+    if (!resume_file.empty()) {
+        HistogramInfo saved = readHistogram(resume_file, v_map[0]);
+        rng_seed = saved.seed;
+        rng = Philox(rng_seed);
+        range[X] = saved.begin;
+        next_sample = saved.end;
+        total_hits = saved.hits;
+        chains = saved.chains;
+        completed = saved.end;
+        for (const Chain& c : chains) completed -= c.last - c.next;
+        std::cout << "Resuming after " << completed << " samples with " << saved.hits << " hits\n";
     }
 
+    if (sampler == Sampler::Grid) {
+        prepare();
+    }
+    std::cout << "Seed: " << rng_seed << "\n";
+    if (simd != Simd::Mode::Off && exponent == 2 && sampler != Sampler::Metropolis) {
+        std::cout << "SIMD: " << Simd::name(Simd::detect()) << ", " << Simd::lanes(simd) << " lanes\n";
+    }
 
-    for (size_t i = 0; i <= size1[Y]; ++i) {
-        for (size_t j = 0; j <= size1[X]; ++j) {
-            for (const Cmap& m : v_map) {
-                map[i][j] += m[i][j];
+    // this thread only reports and keeps time, for a checkpoint, the budget or SIGINT the workers stop
+    // after their current chunk or Metropolis step; checkpoints write the histogram and let them carry on
+    constexpr double report_every = 1;
+    constexpr double poll = 0.05;
+    const size_t begin = completed;
+    Progress progress(budget);
+    double last_checkpoint = 0;
+    bool finished = false;
+
+    auto done = [&]() {
+        const size_t samples = completed - begin;
+        if (range[Y] != 0) return static_cast<double>(samples)/std::max<size_t>(range[Y] - begin, 1);
+        return static_cast<double>(total_hits)/std::max(render_hits, 1);
+    };
+
+    while (!finished) {
+        TaskGroup group;
+        double last_report = progress.elapsed();
+
+        pause = false;
+        for (size_t i = 0; i < pool.size(); ++i) {
+            pool.submit(group, [this, i]{ this->sample(this->v_map[shared ? 0 : i]); }, i);
+        }
+
+        finished = true;
+        while (!pool.wait(group, poll)) {
+            if (progress.elapsed() - last_report >= report_every) {
+                progress.report(completed - begin, total_hits, done());
+                last_report = progress.elapsed();
+            }
+
+            if (progress.stopping()) {
+                pause = true;
+            }
+            else if (checkpoint > 0 && progress.elapsed() - last_checkpoint >= checkpoint) {
+                pause = true;
+                finished = false;
             }
         }
+
+        if (checkpoint > 0) {
+            Histogram total(size[X], size[Y]);
+            total.reduce(v_map);
+            writeHistogram(name + ".hist", total);
+            last_checkpoint = progress.elapsed();
+        }
+        finished = finished || progress.stopping();
     }
+    progress.summary(completed - begin, total_hits);
+
+    Histogram total(size[X], size[Y]);
+    Hmap hist(size[X], size[Y]);
+    total.reduce(v_map);
+    total.copyTo(hist);
     
-    color(map);
+    color(hist, map);
 
     has_run = true;
 }
 
-inline void BuddhabrotBase::addToMap(Cmap& map, const std::vector<complex>& orbit, size_t it)
+void BuddhabrotBase::resume(const std::string& path)
 {
-    Vpoint loc;
-    size_t ch = (it < iter_channel[0]) ? order_channel[0] : ((it < iter_channel[1]) ? order_channel[1] : order_channel[2]);
-    int c = 0;
+    resume_file = path;
+}
+
+// sum of histogram files of the same view, colored as a single render
+void BuddhabrotBase::merge(const std::vector<std::string>& files)
+{
+    std::vector<Histogram> parts;
+    std::vector<HistogramInfo> infos;
+
+    init();
+
+    for (const std::string& f : files) {
+        parts.push_back(Histogram(size[X], size[Y]));
+        infos.push_back(readHistogram(f, parts.back()));
 
-    for (const complex& z : orbit) {
-        if (point2index(z, loc)) {
-            ++map[loc[X]][loc[Y]][ch];
-            ++c;
+        for (size_t k = 0; k + 1 < infos.size(); ++k) {
+            const HistogramInfo& a = infos[k];
+            const HistogramInfo& b = infos.back();
+            if (a.seed == b.seed && a.begin < b.end && b.begin < a.end) {
+                throw std::invalid_argument(f + " repeats samples of " + files[k]);
+            }
         }
     }
 
-    total_hits.fetch_add(c, std::memory_order_relaxed);
+    Histogram total(size[X], size[Y]);
+    Hmap hist(size[X], size[Y]);
+    total.reduce(parts);
+    total.copyTo(hist);
+
+    color(hist, map);
+
+    has_run = true;
+}
+
+HistogramInfo BuddhabrotBase::info() const
+{
+    return {size[X], size[Y], {std::real(tl_corner), std::imag(tl_corner)}, {std::real(tl_lo), std::imag(tl_lo)}, std::real(c_vector),
+        {std::real(n), std::imag(n)}, {std::real(z_seed), std::imag(z_seed)},
+        {iter_channel[0], iter_channel[1], iter_channel[2]}, {order_channel[0], order_channel[1], order_channel[2]},
+        static_cast<uint64_t>(sampler), rng_seed, range[X], sampled(), static_cast<uint64_t>(total_hits), chains};
 }
 
-void BuddhabrotCspace::thread(Cmap& map, const Vpoint& ends)
+static const char histogram_magic[8] = {'F', 'H', 'H', 'I', 'S', 'T', '0', '4'};
+
+// header fields are little endian 64 bit words, a long double is the pair of doubles that sums to it
+static void put(std::ostream& fp, const uint64_t& v)
 {
-    std::random_device rd1, rd2;
-    std::mt19937 e1(rd1()), e2(rd2());
-    std::uniform_real_distribution<> r_dist(0.0, 4.0), t_dist(0, 2*M_PI);
-    std::vector<complex> orbit;
-    size_t iter = 0;
+    char b[8];
+    for (size_t k = 0; k < 8; ++k) {
+        b[k] = static_cast<char>(v >> 8*k);
+    }
+    fp.write(b, sizeof(b));
+}
 
-    orbit.reserve(iter_channel[2]);
-    while (true) {
-        ++iter;
-        complex z = z_seed;
-        complex c;
+static void put(std::ostream& fp, const long double& v)
+{
+    const double hi = static_cast<double>(v);
+    put(fp, std::bit_cast<uint64_t>(hi));
+    put(fp, std::bit_cast<uint64_t>(static_cast<double>(v - hi)));
+}
 
-        double r = std::sqrt(r_dist(e1));
-        double t = t_dist(e2);
-        c = complex(r*std::cos(t), r*std::sin(t));
+static void get(std::istream& fp, uint64_t& v)
+{
+    unsigned char b[8] = {};
+    fp.read(reinterpret_cast<char*>(b), sizeof(b));
+    v = 0;
+    for (size_t k = 0; k < 8; ++k) {
+        v |= static_cast<uint64_t>(b[k]) << 8*k;
+    }
+}
 
-        orbit.clear();
-        for (size_t i = 0; i < iter_channel[2]; ++i) {
-            z = std::pow(z, n) + c;
-            orbit.push_back(z);
-            if (sqrMod(z) >  4) {
-                addToMap(map, orbit, i);
-                break;
-            }
+static void get(std::istream& fp, long double& v)
+{
+    uint64_t hi, lo;
+    get(fp, hi);
+    get(fp, lo);
+    v = static_cast<long double>(std::bit_cast<double>(hi)) + std::bit_cast<double>(lo);
+}
+
+// quad is IEEE binary128, low word first
+static void put(std::ostream& fp, const quad& v)
+{
+    const unsigned __int128 b = std::bit_cast<unsigned __int128>(v);
+    put(fp, static_cast<uint64_t>(b));
+    put(fp, static_cast<uint64_t>(b >> 64));
+}
+
+static void get(std::istream& fp, quad& v)
+{
+    uint64_t lo, hi;
+    get(fp, lo);
+    get(fp, hi);
+    v = std::bit_cast<quad>(static_cast<unsigned __int128>(hi) << 64 | lo);
+}
+
+static void put(std::ostream& fp, const HistogramInfo& h)
+{
+    for (uint64_t v : {h.width, h.height}) put(fp, v);
+    for (long double v : {h.tl[0], h.tl[1], h.tl_lo[0], h.tl_lo[1], h.width_c, h.n[0], h.n[1], h.z_seed[0], h.z_seed[1]}) {
+        put(fp, v);
+    }
+    for (uint64_t v : {h.iter_channel[0], h.iter_channel[1], h.iter_channel[2], h.order_channel[0], h.order_channel[1],
+        h.order_channel[2], h.sampler, h.seed, h.begin, h.end, h.hits}) {
+        put(fp, v);
+    }
+
+    put(fp, static_cast<uint64_t>(h.chains.size()));
+    for (const Chain& c : h.chains) {
+        put(fp, static_cast<uint64_t>(c.next));
+        put(fp, static_cast<uint64_t>(c.last));
+        put(fp, std::real(c.p));
+        put(fp, std::imag(c.p));
+        put(fp, static_cast<uint64_t>(c.tries));
+    }
+}
+
+static void get(std::istream& fp, HistogramInfo& h)
+{
+    for (uint64_t* v : {&h.width, &h.height}) get(fp, *v);
+    for (long double* v : {&h.tl[0], &h.tl[1], &h.tl_lo[0], &h.tl_lo[1], &h.width_c, &h.n[0], &h.n[1], &h.z_seed[0], &h.z_seed[1]}) {
+        get(fp, *v);
+    }
+    for (uint64_t* v : {&h.iter_channel[0], &h.iter_channel[1], &h.iter_channel[2], &h.order_channel[0], &h.order_channel[1],
+        &h.order_channel[2], &h.sampler, &h.seed, &h.begin, &h.end, &h.hits}) {
+        get(fp, *v);
+    }
+
+    uint64_t count = 0, next, last, tries;
+    quad re, im;
+    get(fp, count);
+    for (uint64_t k = 0; fp && k < count; ++k) {
+        get(fp, next);
+        get(fp, last);
+        get(fp, re);
+        get(fp, im);
+        get(fp, tries);
+        h.chains.push_back({next, last, qcomplex(re, im), tries});
+    }
+}
+
+// written next to the final name so an interrupted write never replaces a good checkpoint
+void BuddhabrotBase::writeHistogram(const std::string& path, const Histogram& hist) const
+{
+    const HistogramInfo header = info();
+    const std::string tmp = path + ".tmp";
+
+    {
+        std::ofstream fp(tmp, std::ios::out | std::ios::binary);
+        fp.write(histogram_magic, sizeof(histogram_magic));
+        put(fp, header);
+        hist.write(fp);
+
+        if (!fp) {
+            throw std::runtime_error("Error writing " + tmp);
+        }
+    }
+
+    fs::rename(tmp, path);
+}
+
+HistogramInfo BuddhabrotBase::readHistogram(const std::string& path, Histogram& hist) const
+{
+    std::ifstream fp(path, std::ios::in | std::ios::binary);
+    const HistogramInfo mine = info();
+    HistogramInfo header;
+    char magic[sizeof(histogram_magic)];
+
+    fp.read(magic, sizeof(magic));
+    get(fp, header);
+    if (!fp || !std::equal(magic, magic + sizeof(magic), histogram_magic)) {
+        throw std::runtime_error("Not a histogram file: " + path);
+    }
+
+    // everything but the sampling state has to match the op file
+    if (header.width != mine.width || header.height != mine.height || header.width_c != mine.width_c ||
+        !std::equal(header.tl, header.tl + 2, mine.tl) || !std::equal(header.tl_lo, header.tl_lo + 2, mine.tl_lo) ||
+        !std::equal(header.n, header.n + 2, mine.n) ||
+        !std::equal(header.z_seed, header.z_seed + 2, mine.z_seed) ||
+        !std::equal(header.iter_channel, header.iter_channel + 3, mine.iter_channel) ||
+        !std::equal(header.order_channel, header.order_channel + 3, mine.order_channel) || header.sampler != mine.sampler) {
+        throw std::invalid_argument(path + " does not match the op file (size, view, n, seed point, channels or sampler)");
+    }
+
+    hist.read(fp);
+    if (!fp) {
+        throw std::runtime_error("Truncated histogram file: " + path);
+    }
+
+    return header;
+}
+
+inline size_t BuddhabrotBase::channel(const size_t& it) const
+{
+    return (it < iter_channel[0]) ? order_channel[0] : ((it < iter_channel[1]) ? order_channel[1] : order_channel[2]);
+}
+
+// first pass, whether the orbit escapes and at which iteration, cycles end the bounded ones early (Brent)
+template <typename T, int N>
+bool BuddhabrotBase::escapes(Complex<T> z, const Complex<T>& c, size_t& it) const
+{
+    const Complex<T> n_t(n);
+    const T tol = periodTolerance<T>();
+    Complex<T> saved = z;
+
+    for (size_t m = 0; m < iter_channel[2]; ++m) {
+        z = cpow<N>(z, n_t) + c;
+        if (sqrMod(z) > 4) {
+            it = m;
+            return true;
         }
+        else if (sqrMod(Complex<T>(z - saved)) < tol) {
+            return false;
+        }
+        if ((m & (m + 1)) == 0) saved = z;
+    }
+
+    return false;
+}
+
+// second pass over an orbit that escapes at it, points go straight to the histogram
+template <typename T, int N>
+int BuddhabrotBase::splat(Histogram& hist, Complex<T> z, const Complex<T>& c, const size_t& it) const
+{
+    const Complex<T> n_t(n);
+    const size_t ch = channel(it);
+    // point2index in double, the view is never deep enough to need more and it avoids long double divisions
+    const double left = std::real(tl_corner), top = std::imag(tl_corner);
+    const double right = std::real(br_corner), bottom = std::imag(br_corner);
+    const double sx = size1[X]/std::real(c_vector), sy = size1[Y]/std::imag(c_vector);
+    int hits = 0;
+
+    for (size_t m = 0; m <= it; ++m) {
+        z = cpow<N>(z, n_t) + c;
 
-        if (!(iter % 100000)) {
-            printf("Total hits: %d, render hits: %d\n", total_hits.load(), render_hits);
+        const double x = static_cast<double>(std::real(z));
+        const double y = static_cast<double>(std::imag(z));
+        if (x >= left && x <= right && y <= top && y >= bottom) {
+            hist.add(static_cast<size_t>((y - top)*sy), static_cast<size_t>((x - left)*sx), ch);
+            ++hits;
         }
+    }
+
+    return hits;
+}
+
+// orbits of every claimed sample, point(i, p) gives the random point of sample i or false to skip it.
+// Quadratic orbits still bounded after a few iterations take the rest of the escape test on SIMD lanes
+// for the whole chunk, only the escaping ones are iterated again in T
+template <typename T, int N, typename F>
+void BuddhabrotBase::orbits(Histogram& hist, const bool& zspace, F point)
+{
+    constexpr size_t warmup = 16;   // scalar iterations before a point gets a lane
+    constexpr size_t batch = 1024;  // survivors gathered over chunks so lanes rarely run idle
+    const Complex<T> n_t(n), seed(z_seed);
+    const bool bulbs = !zspace && N == 2 && z_seed == complex(0, 0);
+    const bool lanes = N == 2 && simd != Simd::Mode::Off && iter_channel[2] > warmup;
+    std::vector<double> zr, zi, cr, ci, fr, fi;
+    std::vector<size_t> iter;
+    std::vector<Complex<T>> start;
+    size_t first, last, it, l = 0;
+    Complex<T> p;
+
+    if (lanes) {
+        for (std::vector<double>* v : {&zr, &zi, &cr, &ci, &fr, &fi}) v->resize(batch + chunk);
+        iter.resize(batch + chunk);
+        start.resize(batch + chunk);
+    }
+
+    auto flush = [&]() {
+        int hits = 0;
+
+        Simd::escape({zr.data(), zi.data(), cr.data(), ci.data(), l, iter_channel[2] - warmup, false,
+            iter.data(), fr.data(), fi.data()}, simd);
 
-        if (total_hits >= render_hits) {
-            break;
+        for (size_t k = 0; k < l; ++k) {
+            if (iter[k] >= iter_channel[2] - warmup) continue;
+            hits += splat<T, N>(hist, zspace ? start[k] : seed, zspace ? seed : start[k], warmup + iter[k]);
         }
+
+        total_hits.fetch_add(hits, std::memory_order_relaxed);
+        l = 0;
     };
+
+    while (claim(first, last, chunk)) {
+        int hits = 0;
+
+        for (size_t i = first; i < last; ++i) {
+            if (!point(i, p)) continue;
+
+            const Complex<T> z = zspace ? p : seed;
+            const Complex<T> c = zspace ? seed : p;
+            if (bulbs && circleCardiod(c)) continue;
+
+            if (!lanes) {
+                if (escapes<T, N>(z, c, it)) hits += splat<T, N>(hist, z, c, it);
+                continue;
+            }
+
+            // most points leave within a few iterations, only the ones still bounded are worth a lane
+            Complex<T> w = z;
+            for (it = 0; it < warmup; ++it) {
+                w = cpow<N>(w, n_t) + c;
+                if (sqrMod(w) > 4) break;
+            }
+            if (it < warmup) {
+                hits += splat<T, N>(hist, z, c, it);
+                continue;
+            }
+
+            start[l] = p;
+            zr[l] = std::real(w);
+            zi[l] = std::imag(w);
+            cr[l] = std::real(c);
+            ci[l] = std::imag(c);
+            ++l;
+        }
+
+        total_hits.fetch_add(hits, std::memory_order_relaxed);
+        if (l >= batch) flush();
+        completed.fetch_add(last - first, std::memory_order_relaxed);
+    }
+
+    if (l > 0) flush();
+}
+
+// sample indices [first, last) to work on next, false once the sample range or the hit target is done
+bool BuddhabrotBase::claim(size_t& first, size_t& last, const size_t& chunk)
+{
+    if (pause || (range[Y] == 0 && total_hits >= render_hits)) return false;
+
+    first = next_sample.fetch_add(chunk, std::memory_order_relaxed);
+    last = first + chunk;
+    if (range[Y] != 0) {
+        if (first >= range[Y]) return false;
+        last = std::min(last, range[Y]);
+    }
+
+    return true;
+}
+
+// paused Metropolis chain to carry on with, false when there is none or the run is pausing again; chain
+// is cleared then, for a new one to be claimed into
+bool BuddhabrotBase::takeChain(Chain& chain)
+{
+    std::lock_guard<std::mutex> lock(chain_lock);
+    chain = {};
+    if (pause || chains.empty()) return false;
+
+    chain = chains.back();
+    chains.pop_back();
+    return true;
 }
 
-void BuddhabrotZspace::thread(Cmap& map, const Vpoint& ends)
+// samples handed out so far, counting the end of the range for claims past it
+size_t BuddhabrotBase::sampled() const
 {
-    std::random_device rd1, rd2;
-    std::mt19937 e1(rd1()), e2(rd2());
-    std::uniform_real_distribution<> r_dist(0.0, 4.0), t_dist(0, 2*M_PI);
-    std::vector<complex> orbit;
-    size_t iter = 0;
+    return (range[Y] > 0) ? std::min<size_t>(next_sample, range[Y]) : next_sample.load();
+}
+
+// uniform point of the disk of radius 2 from the counter-based block (i, stream)
+template <typename T>
+Complex<T> BuddhabrotBase::disk(const size_t& i, const uint64_t& stream) const
+{
+    const Philox::Block b = rng(i, stream);
+    const double r = 2*std::sqrt(Philox::unit(b[0], b[1]));
+    const double t = 2*M_PI*Philox::unit(b[2], b[3]);
 
-    orbit.reserve(iter_channel[2]);
-    while (true) {
-        ++iter;
-        complex z;
-        complex c = z_seed;
+    return Complex<T>(r*std::cos(t), r*std::sin(t));
+}
+
+// Metropolis-Hastings walk over the random point (c, or z0 in Z-space) of the disk of radius 2, with
+// target density the number of orbit points that land in the view; every step splats the current orbit
+// with weight 1/points, stochastically rounded, so the histogram matches uniform sampling up to a scale.
+// Samples are steps, each chain of chain_steps starts from scratch and only depends on its index.
+// A pause stops the chain at its next step or start point, its position and current point are kept to carry
+// on later. A view that no orbit reaches ends the run once a chain has tried chain_tries start points
+template <typename T, int N>
+void BuddhabrotBase::metropolis(Histogram& hist, const bool& zspace)
+{
+    constexpr double splats = 16;       // expected increments per step
+    constexpr double large = 0.2;       // chance of a proposal anywhere in the disk
+    const Complex<T> n_t(n), seed(z_seed);
+    const double r_min = 1e-4*std::abs(std::real(c_vector));
+    std::vector<Vpoint> current, proposal;
+    Chain state;
 
-        double r = std::sqrt(r_dist(e1));
-        double t = t_dist(e2);
-        z = complex(r*std::cos(t), r*std::sin(t));
+    // view locations of the orbit of p when it escapes, nothing otherwise
+    auto evaluate = [&](const Complex<T>& p, std::vector<Vpoint>& locs, size_t& ch) {
+        Complex<T> z = zspace ? p : seed;
+        const Complex<T> c = zspace ? seed : p;
+        Vpoint loc;
 
-        orbit.clear();
+        locs.clear();
         for (size_t i = 0; i < iter_channel[2]; ++i) {
-            z = std::pow(z, n) + c;
-            orbit.push_back(z);
-            if (sqrMod(z) >  4) {
-                addToMap(map, orbit, i);
+            z = cpow<N>(z, n_t) + c;
+            if (sqrMod(z) > 4) {
+                ch = channel(i);
+                Complex<T> w = zspace ? p : seed;
+                for (size_t k = 0; k <= i; ++k) {
+                    w = cpow<N>(w, n_t) + c;
+                    if (point2index(toComplex(w), loc)) locs.push_back(loc);
+                }
+                return;
+            }
+        }
+    };
+
+    while (takeChain(state) || claim(state.next, state.last, chain_steps)) {
+        // streams of a chain: 0 starting points, 1 proposals, 2 + m/4 rounding of its m-th point,
+        // top bit large mutations
+        const uint64_t chain = static_cast<uint64_t>(state.next/chain_steps) << 32;
+        const size_t base = state.next - state.next%chain_steps;
+        Complex<T> p_current;
+        size_t ch_current = 0;
+
+        current.clear();
+        if (state.next > base) {
+            p_current = Complex<T>(static_cast<T>(std::real(state.p)), static_cast<T>(std::imag(state.p)));
+            evaluate(p_current, current, ch_current);
+        }
+        for (size_t k = state.tries; current.empty() && (range[Y] != 0 || total_hits < render_hits); ++k) {
+            if (pause) {
+                std::lock_guard<std::mutex> lock(chain_lock);
+                chains.push_back({state.next, state.last, qcomplex(std::real(p_current), std::imag(p_current)), k});
                 break;
             }
+            if (k >= chain_tries) {
+                pause = true;
+                throw std::invalid_argument("No orbit reaches the view");
+            }
+
+            p_current = disk<T>(k, chain);
+            evaluate(p_current, current, ch_current);
         }
 
-        if (!(iter % 100000)) {
-            printf("Total hits: %d, render hits: %d\n", total_hits.load(), render_hits);
+        for (size_t step = state.next - base; !current.empty() && base + step < state.last; ++step) {
+            if (pause) {
+                std::lock_guard<std::mutex> lock(chain_lock);
+                chains.push_back({base + step, state.last, qcomplex(std::real(p_current), std::imag(p_current)), 0});
+                break;
+            }
+
+            const Philox::Block u = rng(step, chain | 1);
+
+            Complex<T> p;
+            if (Philox::unit(u[0]) < large) {
+                p = disk<T>(step, chain | 0x80000000u);
+            }
+            else {
+                double r = r_min*std::exp(4*Philox::unit(u[1]));
+                double t = 2*M_PI*Philox::unit(u[2]);
+                p = p_current + Complex<T>(r*std::cos(t), r*std::sin(t));
+            }
+
+            // symmetric proposals, the acceptance ratio is the ratio of the densities
+            size_t ch = 0;
+            if (sqrMod(p) <= 4) {
+                evaluate(p, proposal, ch);
+                if (!proposal.empty() && Philox::unit(u[3])*current.size() < proposal.size()) {
+                    std::swap(current, proposal);
+                    p_current = p;
+                    ch_current = ch;
+                }
+            }
+
+            const double w = splats/current.size();
+            Philox::Block v;
+            int c = 0;
+            for (size_t m = 0; m < current.size(); ++m) {
+                if (m%4 == 0) v = rng(step, chain | (2 + m/4));
+                uint32_t k = static_cast<uint32_t>(w + Philox::unit(v[m%4]));
+                hist.add(current[m][X], current[m][Y], ch_current, k);
+                c += k;
+            }
+            total_hits.fetch_add(c, std::memory_order_relaxed);
+            completed.fetch_add(1, std::memory_order_relaxed);
+
+            if (range[Y] == 0 && total_hits >= render_hits) break;
         }
+    }
+}
+
+// pre-pass over the grid, a few probes per cell, cells whose probes put nothing in the view or that are
+// inside the cardioid or the bulb are never sampled again
+template <typename T, int N>
+void BuddhabrotBase::importance(const bool& zspace)
+{
+    constexpr size_t probes = 3;
+    const Complex<T> n_t(n), seed(z_seed);
+    const bool bulbs = !zspace && exponent == 2 && z_seed == complex(0, 0);
+    std::vector<char> active(grid*grid, 0);
+
+    parallelFor(grid, 4, [&](size_t begin, size_t end) {
+        Vpoint loc;
+
+        for (size_t i = begin; i < end; ++i) {
+            for (size_t j = 0; j < grid; ++j) {
+                const complex corner(-2 + j*cell, -2 + i*cell);
+                if (bulbs && cellInterior(corner)) continue;
 
-        if (total_hits >= render_hits) {
-            break;
+                for (size_t k = 0; k < probes*probes && !active[i*grid + j]; ++k) {
+                    const Complex<T> p(corner + complex((k%probes + 0.5L)*cell/probes, (k/probes + 0.5L)*cell/probes));
+                    const Complex<T> c = zspace ? seed : p;
+                    Complex<T> z = zspace ? p : seed;
+                    size_t it;
+
+                    if (sqrMod(p) > 4 || !escapes<T, N>(z, c, it)) continue;
+
+                    for (size_t m = 0; m <= it; ++m) {
+                        z = cpow<N>(z, n_t) + c;
+                        if (point2index(toComplex(z), loc)) {
+                            active[i*grid + j] = 1;
+                            break;
+                        }
+                    }
+                }
+            }
         }
-    };
+    });
+
+    cells.clear();
+    for (size_t k = 0; k < active.size(); ++k) {
+        if (active[k]) cells.push_back(k);
+    }
+
+    std::cout << "Importance map: " << cells.size() << " of " << grid*grid << " cells active\n";
+    if (cells.empty()) {
+        throw std::invalid_argument("No orbit reaches the view");
+    }
+}
+
+// uniform over the active cells, sample i always lands in cell i modulo their count
+template <typename T, int N>
+void BuddhabrotBase::stratified(Histogram& hist, const bool& zspace)
+{
+    orbits<T, N>(hist, zspace, [this](const size_t& i, Complex<T>& p) {
+        const uint32_t k = cells[i%cells.size()];
+        const Philox::Block b = rng(i);
+        const complex corner(-2 + (k%grid)*cell, -2 + (k/grid)*cell);
+
+        p = Complex<T>(corner + complex(Philox::unit(b[0], b[1])*cell, Philox::unit(b[2], b[3])*cell));
+        return sqrMod(p) <= 4;
+    });
+}
+
+void BuddhabrotCspace::prepare()
+{
+    dispatchPrecision(scalar, [&](auto T) {
+        dispatchExponent(exponent, [&](auto N){ this->importance<typename decltype(T)::type, N>(false); });
+    });
+}
+
+void BuddhabrotCspace::sample(Histogram& hist)
+{
+    dispatchPrecision(scalar, [&](auto T) {
+        dispatchExponent(exponent, [&](auto N) {
+            if (sampler == Sampler::Metropolis) this->metropolis<typename decltype(T)::type, N>(hist, false);
+            else if (sampler == Sampler::Grid) this->stratified<typename decltype(T)::type, N>(hist, false);
+            else this->kernel<typename decltype(T)::type, N>(hist);
+        });
+    });
+}
+
+template <typename T, int N>
+void BuddhabrotCspace::kernel(Histogram& hist)
+{
+    orbits<T, N>(hist, false, [this](const size_t& i, Complex<T>& p) {
+        p = disk<T>(i);
+        return true;
+    });
+}
+
+void BuddhabrotZspace::prepare()
+{
+    dispatchPrecision(scalar, [&](auto T) {
+        dispatchExponent(exponent, [&](auto N){ this->importance<typename decltype(T)::type, N>(true); });
+    });
+}
+
+void BuddhabrotZspace::sample(Histogram& hist)
+{
+    dispatchPrecision(scalar, [&](auto T) {
+        dispatchExponent(exponent, [&](auto N) {
+            if (sampler == Sampler::Metropolis) this->metropolis<typename decltype(T)::type, N>(hist, true);
+            else if (sampler == Sampler::Grid) this->stratified<typename decltype(T)::type, N>(hist, true);
+            else this->kernel<typename decltype(T)::type, N>(hist);
+        });
+    });
+}
+
+template <typename T, int N>
+void BuddhabrotZspace::kernel(Histogram& hist)
+{
+    orbits<T, N>(hist, true, [this](const size_t& i, Complex<T>& p) {
+        p = disk<T>(i);
+        return true;
+    });
 }
\ No newline at end of file
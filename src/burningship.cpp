@@ -1,30 +1,46 @@
 #include "burningship.hpp"
 
-void BurningShipCspace::thread(Cmap& map, const Vpoint& ends)
+void BurningShipCspace::thread(Emap& data, const Tile& tile)
 {
-    ColorGen::Vcolor color_v;
-
-    for (size_t i = ends[X]; i < ends[Y]; ++i) {
-        for (size_t j = 0; j < size[X]; ++j) {
-            complex c0_c = index2point({j,i});
-            color_v.clear();
-            for (const complex& dz : ssaa_dz) {
-                complex c0 = c0_c + dz;
-                complex z = z_seed;
-                bool non_escape = true;
+    if (simd != Simd::Mode::Off && exponent == 2) {
+        vectorThread(data, tile, z_seed, false, true);
+        return;
+    }
+
+    dispatchPrecision(scalar, [&](auto T) {
+        dispatchExponent(exponent, [&](auto N){ this->kernel<typename decltype(T)::type, N>(data, tile); });
+    });
+}
+
+template <typename T, int N>
+void BurningShipCspace::kernel(Emap& data, const Tile& tile)
+{
+    const Complex<T> n_t(n);
+    const T tol = periodTolerance<T>();
+
+    for (size_t i = tile.rows[X]; i < tile.rows[Y]; ++i) {
+        for (size_t j = tile.cols[X]; j < tile.cols[Y]; ++j) {
+            Complex<T> c0_c = index2point<T>({j,i});
+            Sample* out = data(i, j);
+            for (size_t s = subsamples[X]; s < subsamples[Y]; ++s) {
+                Complex<T> c0 = c0_c + Complex<T>(ssaa_dz[s]);
+                Complex<T> z(z_seed);
+                Complex<T> saved = z;
+                out[s] = {Sample::interior, 0};
                 for (size_t k = 0; k < max_iterations; ++k) {
-                    z = std::pow(complex(std::abs(z.real()), std::abs(z.imag())), n) + c0;
-                    if (sqrMod(z) > 4) {
-                        non_escape = false;
-                        color_v.push_back(color(k, z));
+                    z = cpow<N>(fold(z), n_t) + c0;
+                    const T r = sqrMod(z);
+                    if (r > 4) {
+                        out[s] = {static_cast<uint32_t>(k), static_cast<float>(r)};
                         break;
                     }
-                }
-                if (non_escape) {
-                    color_v.push_back(base_color);
+                    else if (sqrMod(Complex<T>(z - saved)) < tol) {
+                        break;
+                    }
+                    // Brent: the orbit is compared against z at the last power of two
+                    if ((k & (k + 1)) == 0) saved = z;
                 }
             }
-            map[size1[Y] - i][j] = ColorGen::averageColor(color_v);   
         }
     }
 }
@@ -34,30 +50,46 @@ void BurningShipCspace::thread(Cmap& map, const Vpoint& ends)
 
 
 
-void BurningShipZspace::thread(Cmap& map, const Vpoint& ends)
+void BurningShipZspace::thread(Emap& data, const Tile& tile)
 {
-    ColorGen::Vcolor color_v;
-
-    for (size_t i = ends[X]; i < ends[Y]; ++i) {
-        for (size_t j = 0; j < size[X]; ++j) {
-            complex z_c = index2point({j,i});
-            color_v.clear();
-            for (const complex& dz : ssaa_dz) {
-                complex z = z_c + dz;
-                bool non_escape = true;
+    if (simd != Simd::Mode::Off && exponent == 2) {
+        vectorThread(data, tile, c, true, true);
+        return;
+    }
+
+    dispatchPrecision(scalar, [&](auto T) {
+        dispatchExponent(exponent, [&](auto N){ this->kernel<typename decltype(T)::type, N>(data, tile); });
+    });
+}
+
+template <typename T, int N>
+void BurningShipZspace::kernel(Emap& data, const Tile& tile)
+{
+    const Complex<T> n_t(n), c_t(c);
+    const T tol = periodTolerance<T>();
+
+    for (size_t i = tile.rows[X]; i < tile.rows[Y]; ++i) {
+        for (size_t j = tile.cols[X]; j < tile.cols[Y]; ++j) {
+            Complex<T> z_c = index2point<T>({j,i});
+            Sample* out = data(i, j);
+            for (size_t s = subsamples[X]; s < subsamples[Y]; ++s) {
+                Complex<T> z = z_c + Complex<T>(ssaa_dz[s]);
+                Complex<T> saved = z;
+                out[s] = {Sample::interior, 0};
                 for (size_t k = 0; k < max_iterations; ++k) {
-                    z = std::pow(complex(std::abs(z.real()), std::abs(z.imag())), n) + c;
-                    if (sqrMod(z) > 4) {
-                        non_escape = false;
-                        color_v.push_back(color(k, z));
+                    z = cpow<N>(fold(z), n_t) + c_t;
+                    const T r = sqrMod(z);
+                    if (r > 4) {
+                        out[s] = {static_cast<uint32_t>(k), static_cast<float>(r)};
                         break;
                     }
-                }
-                if (non_escape) {
-                    color_v.push_back(base_color);
+                    else if (sqrMod(Complex<T>(z - saved)) < tol) {
+                        break;
+                    }
+                    // Brent: the orbit is compared against z at the last power of two
+                    if ((k & (k + 1)) == 0) saved = z;
                 }
             }
-            map[size1[Y] - i][j] = ColorGen::averageColor(color_v);
         }
     }
 }
\ No newline at end of file
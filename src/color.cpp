@@ -1,5 +1,122 @@
 #include "color.hpp"
 
+#include <bit>
+
+// natural log to about 1e-6 relative, branch free so whole rows vectorize: the mantissa is moved
+// to [sqrt(1/2), sqrt(2)) and log m = 2 atanh((m - 1)/(m + 1)) taken to the fifth power
+static inline float fastLog(const float& x)
+{
+    const uint32_t bits = std::bit_cast<uint32_t>(x);
+    const uint32_t high = ((bits & 0x007FFFFFu) > 0x003504F3u) ? 1u : 0u;
+    const float e = static_cast<float>(static_cast<int32_t>(bits >> 23) - 127 + static_cast<int32_t>(high));
+    const float m = std::bit_cast<float>((bits & 0x007FFFFFu) | ((127u - high) << 23));
+    const float t = (m - 1)/(m + 1);
+    const float t2 = t*t;
+
+    return e*0.69314718f + 2*t*(1 + t2*(1.0f/3 + t2*(1.0f/5)));
+}
+
+namespace Palette {
+
+    Smooth::Smooth(const std::vector<Pcolor>& colors, const long double& p)
+        : inv_lp(1/std::log(p)), log_2lp(std::log(2*std::log(p)))
+    {
+        for (const Pcolor& c : colors) {
+            table.push_back({static_cast<float>(c[0]), static_cast<float>(c[1]), static_cast<float>(c[2])});
+        }
+    }
+
+    // smooth count n + 1 - log(log r/(2 log p))/log p, r = |z|^2 at escape
+    inline float Smooth::index(const uint32_t& n, const float& r) const
+    {
+        return static_cast<float>(n) + 1 - (fastLog(fastLog(std::max(r, 2.0f))) - log_2lp)*inv_lp;
+    }
+
+    inline void Smooth::lookup(const float& x, float* c) const
+    {
+        const float size = static_cast<float>(table.size());
+        const float w = x - size*std::floor(x/size);
+        const size_t i = std::min(static_cast<size_t>(w), table.size() - 1);
+        const float t = w - static_cast<float>(i);
+        const std::array<float, 3>& a = table[i];
+        const std::array<float, 3>& b = table[(i + 1)%table.size()];
+
+        for (size_t k = 0; k < 3; ++k) {
+            c[k] = a[k] + (b[k] - a[k])*t;
+        }
+    }
+
+    Pcolor Smooth::operator()(const size_t& n, const long double& r) const
+    {
+        float c[3];
+        lookup(index(static_cast<uint32_t>(n), static_cast<float>(r)), c);
+
+        return {std::lround(c[0]), std::lround(c[1]), std::lround(c[2])};
+    }
+
+    inline Pcolor Roots::operator()(const size_t& n, const long double& root) const
+    {
+        return colors[static_cast<size_t>(root)];
+    }
+
+    inline Pcolor ShadedRoots::operator()(const size_t& n, const long double& root) const
+    {
+        const size_t r = static_cast<size_t>(root);
+        const double k = std::exp(-shading*(n + static_cast<double>(root - r)));
+        const Pcolor& c = colors[r];
+
+        return Pcolor{std::lround(c[R]*k), std::lround(c[G]*k), std::lround(c[B]*k)};
+    }
+}
+
+// samples of a row averaged into pixels, the palette call is resolved at compile time for all but Function
+template <typename P>
+static void shade(const P& palette, const Sample* in, const size_t& pixels, const size_t& samples, const Pcolor& base, Cmap::Pixel* out)
+{
+    for (size_t j = 0; j < pixels; ++j) {
+        Pcolor sum = BLACK;
+        for (size_t k = j*samples; k < (j + 1)*samples; ++k) {
+            sum += (in[k].iter == Sample::interior) ? base : palette(in[k].iter, in[k].value);
+        }
+        out[j] = sum/static_cast<long>(samples);
+    }
+}
+
+// tables first get the smooth count of the whole row in one loop and only then look colors up
+static void shade(const Palette::Smooth& palette, const Sample* in, const size_t& pixels, const size_t& samples, const Pcolor& base, Cmap::Pixel* out)
+{
+    const size_t count = pixels*samples;
+    std::vector<float> x(count);
+
+    for (size_t k = 0; k < count; ++k) {
+        x[k] = palette.index(in[k].iter, in[k].value);
+    }
+
+    for (size_t j = 0; j < pixels; ++j) {
+        float sum[3] = {0, 0, 0}, c[3];
+        for (size_t k = j*samples; k < (j + 1)*samples; ++k) {
+            if (in[k].iter == Sample::interior) {
+                for (size_t m = 0; m < 3; ++m) sum[m] += base[m];
+                continue;
+            }
+            palette.lookup(x[k], c);
+            for (size_t m = 0; m < 3; ++m) sum[m] += c[m];
+        }
+        out[j] = Pcolor{std::lround(sum[0]/samples), std::lround(sum[1]/samples), std::lround(sum[2]/samples)};
+    }
+}
+
+Pcolor Cfunction::operator()(const size_t& n, const long double& value) const
+{
+    return std::visit([&](const auto& p){ return p(n, value); }, kind);
+}
+
+// pixels of samples consecutive samples each, averaged into out
+void Cfunction::row(const Sample* in, const size_t& pixels, const size_t& samples, const Pcolor& base, Cmap::Pixel* out) const
+{
+    std::visit([&](const auto& p){ shade(p, in, pixels, samples, base, out); }, kind);
+}
+
 namespace ColorGen {
 
     Pcolor averageColor(const Vcolor& color)
@@ -22,7 +139,6 @@ namespace ColorGen {
     Cfunction generateSmooth(const VCpair& colors_pair, const long double& p)
     {
         Vcolor colors;
-        long double lp = std::log(p);
 
         for (size_t i = 0; i < colors_pair.size()-1; ++i) {
             const auto [c1, k1] = colors_pair[i];
@@ -38,38 +154,18 @@ namespace ColorGen {
             colors.push_back(c1 + (c2 - c1)*((static_cast<double>(k))/(static_cast<double>(k1))));
         }
 
-        Cfunction res = [colors, lp](const size_t& n, const complex& z) {
-            long double nu = std::log(std::log(sqrMod(z))/(2*lp))/lp;
-            size_t it = (static_cast<size_t>(static_cast<long double>(n) + 1 - nu))%colors.size();
-
-            return colors[it];
-        };
-
-        return res;
+        return Palette::Smooth(colors, p);
     }
 
-    Cfunction generateRootsSimple(const Vcolor& color, const Vcomplex& roots)
+    // the value of a Newton sample is the index of the root it converged to
+    Cfunction generateRootsSimple(const Vcolor& color)
     {
-        if (color.size() != roots.size()) {
-            // throw error
-        }
-
-        Cfunction res = [color, roots](const size_t& n, const complex& z) {
-            long double r = std::numeric_limits<long double>::infinity();
-            size_t k = 0;
-
-            for (size_t i = 0; i < roots.size(); ++i) {
-                long double r_n = sqrMod(z - roots[i]);
-                if (r_n < r) {
-                    r = r_n;
-                    k = i;
-                }
-            }
-
-            return color[k];
-        };
+        return Palette::Roots{color};
+    }
 
-        return res;
+    Cfunction generateRootsShaded(const Vcolor& color, const double& shading)
+    {
+        return Palette::ShadedRoots{color, shading};
     }
 
 
@@ -84,7 +180,7 @@ namespace ColorGen {
         switch (type)
         {
         case 0:
-            res = [](const size_t& n, const complex& z) { return WHITE; };
+            res = Palette::Smooth({WHITE}, 2);
             break;
         
         case 1:
@@ -119,24 +215,26 @@ namespace ColorGen {
 
 
 
-    void threeChannel(Cmap& map)
+    void threeChannel(const Hmap& hist, Cmap& map)
     {
-        Pcolor max_color = {0, 0, 0};
-        for (const std::vector<Pcolor>& vc : map) {
-            for (const Pcolor& c : vc) {
-                for (size_t i = 0; i < 3; ++i) {
-                    if (c[i] > max_color[i]) {
-                        max_color[i] = c[i];
+        Pcolor max_color = {1, 1, 1};
+        for (size_t i = 0; i < hist.height(); ++i) {
+            for (const Pcolor c : std::span(hist[i], hist.width())) {
+                for (size_t k = 0; k < 3; ++k) {
+                    if (c[k] > max_color[k]) {
+                        max_color[k] = c[k];
                     }
                 }
             }
         }
 
-        for (std::vector<Pcolor>& vc : map) {
-            for (Pcolor& c : vc) {
-                for (size_t i = 0; i < 3; ++i) {
-                    c[i] = (255*c[i])/max_color[i];
+        for (size_t i = 0; i < hist.height(); ++i) {
+            for (size_t j = 0; j < hist.width(); ++j) {
+                Pcolor c = hist[i][j];
+                for (size_t k = 0; k < 3; ++k) {
+                    c[k] = (255*c[k])/max_color[k];
                 }
+                map[i][j] = c;
             }
         }
     }
@@ -155,21 +253,21 @@ namespace ColorGen {
         }
         colors.push_back(colors_pair.back().first);
 
-        Cconverter res = [colors](Cmap& map) {
-            size_t len = colors.size()-1;
-            long big = 0;
+        Cconverter res = [colors](const Hmap& hist, Cmap& map) {
+            long len = colors.size()-1;
+            long big = 1;
 
-            for (const std::vector<Pcolor>& v : map) {
-                for (const Pcolor& c : v) {
+            for (size_t i = 0; i < hist.height(); ++i) {
+                for (const Pcolor c : std::span(hist[i], hist.width())) {
                     if (c[X] > big) {
                         big = c[X];
                     }
                 }
             }
 
-            for (std::vector<Pcolor>& v : map) {
-                for (Pcolor& c : v) {
-                    c = colors[(c[X]*len)/big];
+            for (size_t i = 0; i < hist.height(); ++i) {
+                for (size_t j = 0; j < hist.width(); ++j) {
+                    map[i][j] = colors[(hist[i][j][X]*len)/big];
                 }
             }
         };
@@ -216,26 +314,31 @@ namespace ColorGen {
 
     Cconverter generateThreeChannel(const double& threshold)
     {
-        return [threshold](Cmap& map){
+        return [threshold](const Hmap& hist, Cmap& map){
             Pcolor max_color = {0, 0, 0};
-            for (const std::vector<Pcolor>& vc : map) {
-                for (const Pcolor& c : vc) {
-                    for (size_t i = 0; i < 3; ++i) {
-                        if (c[i] > max_color[i]) {
-                            max_color[i] = c[i];
+            for (size_t i = 0; i < hist.height(); ++i) {
+                for (const Pcolor c : std::span(hist[i], hist.width())) {
+                    for (size_t k = 0; k < 3; ++k) {
+                        if (c[k] > max_color[k]) {
+                            max_color[k] = c[k];
                         }
                     }
                 }
             }
 
             max_color = max_color*(1.0-threshold);
+            for (long& m : max_color) {
+                m = std::max(m, 1L);
+            }
 
-            for (std::vector<Pcolor>& vc : map) {
-                for (Pcolor& c : vc) {
-                    for (size_t i = 0; i < 3; ++i) {
-                        c[i] = (255*c[i])/max_color[i];
-                        if (c[i] > 255) c[i] = 255;
+            for (size_t i = 0; i < hist.height(); ++i) {
+                for (size_t j = 0; j < hist.width(); ++j) {
+                    Pcolor c = hist[i][j];
+                    for (size_t k = 0; k < 3; ++k) {
+                        c[k] = (255*c[k])/max_color[k];
+                        if (c[k] > 255) c[k] = 255;
                     }
+                    map[i][j] = c;
                 }
             }
         };
@@ -0,0 +1,42 @@
+#include "escape.hpp"
+
+#include <fstream>
+
+static const char escape_magic[8] = {'F', 'H', 'E', 'S', 'C', '0', '0', '1'};
+
+void Emap::save(const std::string& path) const
+{
+    std::ofstream fp(path, std::ios::out | std::ios::binary);
+    uint64_t header[3] = {w, h, s};
+
+    fp.write(escape_magic, sizeof(escape_magic));
+    fp.write(reinterpret_cast<const char*>(header), sizeof(header));
+    fp.write(reinterpret_cast<const char*>(buffer.data()), buffer.size()*sizeof(Sample));
+
+    if (!fp) {
+        throw std::runtime_error("Error writing " + path);
+    }
+}
+
+void Emap::load(const std::string& path)
+{
+    std::ifstream fp(path, std::ios::in | std::ios::binary);
+    char magic[sizeof(escape_magic)];
+    uint64_t header[3];
+
+    fp.read(magic, sizeof(magic));
+    fp.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!fp || !std::equal(magic, magic + sizeof(magic), escape_magic)) {
+        throw std::runtime_error("Not an escape data file: " + path);
+    }
+
+    w = header[0];
+    h = header[1];
+    s = header[2];
+    buffer.resize(w*h*s);
+    fp.read(reinterpret_cast<char*>(buffer.data()), buffer.size()*sizeof(Sample));
+
+    if (!fp) {
+        throw std::runtime_error("Truncated escape data file: " + path);
+    }
+}
@@ -1,8 +1,5 @@
 #include "fractal.hpp"
 
-//#undef Nthreads
-//#define Nthreads 1
-
 void FractalThread::setOpFile(const std::string& op_file)
 {
     this->op_file = op_file;
@@ -17,11 +14,12 @@ void FractalThread::setDimensions(complex tl_corner, long double x_size, Vpoint
     c_vector = {x_size, -x_size*size[Y]/size[X]};
     br_corner = tl_corner + c_vector;
 
+    // adaptive supersampling renders the center of every pixel first
     ssaa_dz.clear();
-    if (ssaa == 0) {
+    if (ssaa == 0 || adaptive >= 0) {
         ssaa_dz.push_back({0,0});
     }
-    else {
+    if (ssaa != 0) {
         long double dx = std::abs(std::real(c_vector))/size1[X];
         long double dy = std::abs(std::imag(c_vector))/size1[Y];
 
@@ -37,11 +35,38 @@ void FractalThread::setDimensions(complex tl_corner, long double x_size, Vpoint
             }
         }
     }
+    subsamples = {0, ssaa_dz.size()};
+
+    scalar = resolvePrecision();
+}
+
+// cheapest scalar whose spacing around the view stays well below the distance between samples
+Precision FractalThread::resolvePrecision() const
+{
+    if (precision != Precision::Auto) {
+        return precision;
+    }
+
+    long double step = std::abs(std::real(c_vector))/size1[X];
+    if (ssaa != 0) {
+        step /= (ssaa + 1)/2 + 2;
+    }
+
+    long double mag = std::max({std::abs(tl_corner.real()), std::abs(tl_corner.imag()),
+        std::abs(br_corner.real()), std::abs(br_corner.imag()), 2.0L});
+    long double margin = 1024*mag;
+
+    if (step > margin*std::numeric_limits<float>::epsilon()) return Precision::Float;
+    else if (step > margin*std::numeric_limits<double>::epsilon()) return Precision::Double;
+    else if (step > margin*std::numeric_limits<long double>::epsilon()) return Precision::Long;
+
+    return Precision::Quad;
 }
 
-complex FractalThread::index2point(const Vpoint& loc) const
+// position relative to tl_corner, small enough to stay exact in deep zooms
+complex FractalThread::index2offset(const Vpoint& loc) const
 {
-    return tl_corner + complex((std::real(c_vector)*loc[X])/size1[X], (std::imag(c_vector)*loc[Y])/size1[Y]);
+    return {(std::real(c_vector)*(loc[X] + origin[X]))/size1[X], (std::imag(c_vector)*(loc[Y] + origin[Y]))/size1[Y]};
 }
 
 bool FractalThread::point2index(const complex& z, Vpoint& loc) const
@@ -59,78 +84,712 @@ bool FractalThread::point2index(const complex& z, Vpoint& loc) const
     return true;
 }
 
+// quadratic escape-time kernels on SIMD lanes, seed is z0 in C-space and c in Z-space
+void FractalThread::vectorThread(Emap& data, const Tile& tile, const complex& seed, const bool& zspace, const bool& burning)
+{
+    const size_t samples = subsamples[Y] - subsamples[X];
+    size_t count = (tile.rows[Y] - tile.rows[X])*(tile.cols[Y] - tile.cols[X])*samples;
+    std::vector<double> zr(count), zi(count), cr(count), ci(count), fr(count), fi(count);
+    std::vector<size_t> iter(count);
+    std::vector<char> inside(count, 0);
+    const bool bulbs = !zspace && !burning && seed == complex(0, 0);
+    size_t s = 0, l = 0;
+
+    // samples in the cardioid or the period-2 bulb never get a lane
+    for (size_t i = tile.rows[X]; i < tile.rows[Y]; ++i) {
+        for (size_t j = tile.cols[X]; j < tile.cols[Y]; ++j) {
+            complex p = index2point({j,i});
+            for (size_t k = subsamples[X]; k < subsamples[Y]; ++k) {
+                complex z = zspace ? p + ssaa_dz[k] : seed;
+                complex c = zspace ? seed : p + ssaa_dz[k];
+                if (bulbs && circleCardiod(c)) {
+                    inside[s++] = 1;
+                    continue;
+                }
+                zr[l] = std::real(z);
+                zi[l] = std::imag(z);
+                cr[l] = std::real(c);
+                ci[l] = std::imag(c);
+                ++s;
+                ++l;
+            }
+        }
+    }
+
+    Simd::escape({zr.data(), zi.data(), cr.data(), ci.data(), l, max_iterations, burning,
+        iter.data(), fr.data(), fi.data()}, simd);
+
+    s = l = 0;
+    for (size_t i = tile.rows[X]; i < tile.rows[Y]; ++i) {
+        for (size_t j = tile.cols[X]; j < tile.cols[Y]; ++j) {
+            Sample* out = data(i, j);
+            for (size_t k = subsamples[X]; k < subsamples[Y]; ++k, ++s) {
+                if (inside[s]) {
+                    out[k] = {Sample::interior, 0};
+                    continue;
+                }
+                if (iter[l] < max_iterations) out[k] = {static_cast<uint32_t>(iter[l]), static_cast<float>(fr[l]*fr[l] + fi[l]*fi[l])};
+                else out[k] = {Sample::interior, 0};
+                ++l;
+            }
+        }
+    }
+}
+
 void FractalThread::init()
 {
-    map = Cmap(size[Y], std::vector<Pcolor>(size[X], base_color));
+    map = Cmap(size[X], size[Y], base_color);
+}
+
+// whether the colors are kept in map: for ImageMagick, the levels of a pyramid and images not streamed to
+// a PNG; otherwise they only pass through band sized buffers on their way to the PNG
+bool FractalThread::keepsImage() const
+{
+    return !png || (tiled && pyramid);
+}
+
+// whether the image is computed, colored and compressed strip by strip, unless the whole escape buffer is
+// needed afterwards: by adaptive supersampling, the glitch passes of deep zooms, frame prediction or
+// --save-escape
+bool FractalThread::streamed() const
+{
+    return png && adaptive < 0 && !perturbed && !keep_escape && !(frames && full);
+}
+
+// palette over the escape rows [rows[X], rows[Y]), the samples of a pixel are averaged; an open PNG gets
+// every band as soon as it is colored
+void FractalThread::colorize(const Vpoint& rows)
+{
+    const bool keep = keepsImage();
+
+    parallelFor(rows[Y] - rows[X], band, [&](size_t begin, size_t end) {
+        const size_t first = flip ? size[Y] - rows[X] - end : rows[X] + begin;
+        Cmap colors;
+
+        if (!keep) colors = Cmap(size[X], end - begin);
+        for (size_t i = rows[X] + begin; i < rows[X] + end; ++i) {
+            const size_t r = (flip ? size[Y] - 1 - i : i) - first;
+            palette.row(escape(i, 0), size[X], escape.samples(), base_color, keep ? map[first + r] : colors[r]);
+        }
+
+        if (png) {
+            const Cmap& image = keep ? map : colors;
+            png->band(first, end - begin, reinterpret_cast<const uint8_t*>(image[keep ? first : 0]), image.stride()*sizeof(Cmap::Pixel));
+        }
+    });
+}
+
+// 2x2 averages of src written to dst from its pixel at, odd last rows and columns average what they have
+static void halve(const Cmap& src, Cmap& dst, const Vpoint& at)
+{
+    for (size_t i = 0; 2*i < src.height(); ++i) {
+        const size_t rows = std::min<size_t>(2, src.height() - 2*i);
+        for (size_t j = 0; 2*j < src.width(); ++j) {
+            const size_t cols = std::min<size_t>(2, src.width() - 2*j);
+            const long n = rows*cols;
+            Pcolor sum = {0,0,0};
+            for (size_t y = 0; y < rows; ++y) {
+                for (size_t x = 0; x < cols; ++x) {
+                    sum += Pcolor(src[2*i + y][2*j + x]);
+                }
+            }
+            for (long& c : sum) {
+                c = (c + n/2)/n;
+            }
+            dst[at[Y] + i][at[X] + j] = sum;
+        }
+    }
+}
+
+// a whole framebuffer in bands on the pool, png and image have to outlive the group
+static void encode(TaskGroup& group, PngWriter& png, const Cmap& image)
+{
+    for (size_t i = 0; i < image.height(); i += 16) {
+        ThreadPool::instance().submit(group, [&png, &image, i]{
+            const size_t count = std::min<size_t>(16, image.height() - i);
+            png.band(i, count, reinterpret_cast<const uint8_t*>(image[i]), image.stride()*sizeof(Cmap::Pixel));
+        });
+    }
 }
 
 void FractalThread::run()
 {
-    std::vector<std::thread> t_vector;
-    
     if (has_run) return;
 
-    init();
+    if (frames) animate();
+    else if (tiled) renderTiles();
+    else render();
+
+    has_run = true;
+}
+
+// escape data and colors of the buffer, the whole image or one tile of it
+void FractalThread::render()
+{
+    if (streamed()) {
+        iterateStrips();
+        return;
+    }
+
+    iterate();
+    colorize();
+}
+
+// out-of-core render: tiles of tiled px are rendered, written and dropped one after the other; with the
+// pyramid they come from a quadtree walk that averages each level from the one above on the way back,
+// so no more than four tiles per level are ever held
+void FractalThread::renderTiles()
+{
+    const Vpoint image = size;
+
+    top_level = 0;
+    while ((size_t{1} << top_level) < std::max(image[X], image[Y])) ++top_level;
+
+    for (size_t level = pyramid ? 0 : top_level; level <= top_level; ++level) {
+        fs::create_directories(fs::path{image_name + "_files/" + std::to_string(level)});
+    }
+
+    tiles_done = 0;
+    if (!pyramid) {
+        for (size_t i = 0; i*tiled < image[Y]; ++i) {
+            for (size_t j = 0; j*tiled < image[X]; ++j) {
+                renderTile({j,i});
+            }
+        }
+    }
+    else {
+        // first level that fits in a single tile, the ones below it are halved from it
+        size_t level = top_level;
+        while (level > 0 && std::max(image[X], image[Y]) > (tiled << (top_level - level))) --level;
+
+        Cmap top = reduce(level, {0,0});
+        while (level-- > 0) {
+            Cmap half(std::max<size_t>(1, (top.width() + 1)/2), std::max<size_t>(1, (top.height() + 1)/2));
+            halve(top, half, {0,0});
+            writeTile(half, level, {0,0});
+            top = std::move(half);
+        }
+    }
+    std::cout << "\n";
+
+    size = image;
+    origin = {0,0};
+    map = Cmap();
+    escape = Emap();
+}
+
+// tile t of the given Deep Zoom level, from its four children one level up
+Cmap FractalThread::reduce(const size_t& level, const Vpoint& t)
+{
+    if (level == top_level) {
+        renderTile(t);
+        return std::move(map);
+    }
+
+    // size of the image at a level, halved with rounding up from the top one
+    const Vpoint image = size1 + Vpoint{1,1};
+    auto at = [&](const size_t& l) {
+        const size_t shift = top_level - l;
+        return Vpoint{(image[X] + (size_t{1} << shift) - 1) >> shift, (image[Y] + (size_t{1} << shift) - 1) >> shift};
+    };
+    const Vpoint dims = at(level);
+    const Vpoint child_dims = at(level + 1);
+    Cmap out(std::min(tiled, dims[X] - t[X]*tiled), std::min(tiled, dims[Y] - t[Y]*tiled), base_color);
+
+    for (size_t i = 0; i < 2; ++i) {
+        for (size_t j = 0; j < 2; ++j) {
+            const Vpoint c = {2*t[X] + j, 2*t[Y] + i};
+            if (c[X]*tiled >= child_dims[X] || c[Y]*tiled >= child_dims[Y]) continue;
+
+            halve(reduce(level + 1, c), out, {j*tiled/2, i*tiled/2});
+        }
+    }
+
+    writeTile(out, level, t);
+
+    return out;
+}
+
+// full resolution tile t, left colored in map
+void FractalThread::renderTile(const Vpoint& t)
+{
+    const Vpoint image = size1 + Vpoint{1,1};
+    const size_t count = ((image[X] + tiled - 1)/tiled)*((image[Y] + tiled - 1)/tiled);
+
+    size = {std::min(tiled, image[X] - t[X]*tiled), std::min(tiled, image[Y] - t[Y]*tiled)};
+    origin = {t[X]*tiled, flip ? image[Y] - t[Y]*tiled - size[Y] : t[Y]*tiled};
 
-    for (size_t i = 0; i < Nthreads; ++i) {
-        Vpoint ends = {i*size[Y]/Nthreads, (i+1)*size[Y]/Nthreads};
-        t_vector.push_back(std::thread([&, ends]{ this->thread(this->map, ends); }));
+    png = std::make_unique<PngWriter>(image_name + "_files/" + std::to_string(top_level) + "/"
+        + std::to_string(t[X]) + "_" + std::to_string(t[Y]) + ".png", size[X], size[Y]);
+    render();
+    png->close();
+    png.reset();
+
+    std::cout << "\rTile " << ++tiles_done << "/" << count << std::flush;
+}
+
+void FractalThread::writeTile(const Cmap& image, const size_t& level, const Vpoint& t) const
+{
+    PngWriter out(image_name + "_files/" + std::to_string(level) + "/" + std::to_string(t[X]) + "_"
+        + std::to_string(t[Y]) + ".png", image.width(), image.height());
+    TaskGroup group;
+
+    encode(group, out, image);
+    ThreadPool::instance().wait(group);
+    out.close();
+}
+
+// zoom animation from the view of the op file to zoom_to: x_size changes geometrically and the center
+// follows so that the end stays put on screen. Every frame is streamed to its own PNG as it is computed
+void FractalThread::animate()
+{
+    const long double start_size = x_size;
+    const qcomplex start = qcomplex(tl_corner) + qcomplex(tl_lo) + qcomplex(c_vector)/quad(2);
+    const qcomplex end = qcomplex(zoom_to) + qcomplex(zoom_to_lo);
+    size_t reused = 0;
+
+    for (size_t k = 0; k < frames; ++k) {
+        const long double t = (frames > 1) ? static_cast<long double>(k)/(frames - 1) : 0;
+        const long double x = (k + 1 == frames) ? zoom_size : start_size*std::pow(zoom_size/start_size, t);
+        const long double s = (zoom_size == start_size) ? t : (start_size - x)/(start_size - zoom_size);
+        const qcomplex tl = start + (end - start)*quad(s) + qcomplex(complex(-x/2, (x*size[Y])/size[X]/2));
+
+        if (k > 0) {
+            previous = std::move(escape);
+            previous_tl = qcomplex(tl_corner) + qcomplex(tl_lo);
+            previous_step = {std::real(c_vector)/size1[X], std::imag(c_vector)/size1[Y]};
+        }
+        tl_corner = toComplex(tl);
+        tl_lo = toComplex(tl - qcomplex(tl_corner));
+        x_size = x;
+        setDimensions(tl_corner, x_size, size);
+
+        char number[32];
+        std::snprintf(number, sizeof(number), "_%05zu.png", k);
+        png = std::make_unique<PngWriter>(image_name + number, size[X], size[Y]);
+        render();
+        png->close();
+        png.reset();
+        reused += filled;
+
+        std::cout << "\rFrame " << k + 1 << "/" << frames << std::flush;
     }
 
-    for (std::thread& t : t_vector) {
-        t.join();
+    std::cout << "\n";
+    if (full) {
+        std::cout << "Prediction: " << (100.0*reused)/(frames*size[X]*size[Y]) << "% of the pixels filled from the previous frame\n";
+    }
+    previous = Emap();
+}
+
+// whether the previous frame of a zoom saw nothing but interior around tile t, with a pixel to spare;
+// the tile then only iterates its border and is filled or subdivided like in Mariani-Silver
+bool FractalThread::predicted(const Tile& t) const
+{
+    if (!full || previous.samples() == 0) {
+        return false;
     }
 
+    // tile corners in pixels of the previous frame
+    const complex shift = toComplex(qcomplex(tl_corner) + qcomplex(tl_lo) - previous_tl);
+    const complex a = shift + index2offset({t.cols[X], t.rows[X]});
+    const complex b = shift + index2offset({t.cols[Y] - 1, t.rows[Y] - 1});
+    const long double x0 = std::floor(std::real(a)/std::real(previous_step)) - 1;
+    const long double y0 = std::floor(std::imag(a)/std::imag(previous_step)) - 1;
+    const long double x1 = std::ceil(std::real(b)/std::real(previous_step)) + 1;
+    const long double y1 = std::ceil(std::imag(b)/std::imag(previous_step)) + 1;
+
+    if (x0 < 0 || y0 < 0 || x1 >= previous.width() || y1 >= previous.height()) {
+        return false;
+    }
+
+    for (size_t i = y0; i <= y1; ++i) {
+        for (size_t j = x0; j <= x1; ++j) {
+            const Sample* in = previous(i, j);
+            for (size_t k = 0; k < previous.samples(); ++k) {
+                if (in[k].iter != Sample::interior) return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// tiles of data on the pool, contiguous runs of them per worker, idle workers steal from the others
+void FractalThread::submitTiles(TaskGroup& group, Emap& data, const std::vector<Tile>& tiles)
+{
+    ThreadPool& pool = ThreadPool::instance();
+
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        const Tile t = tiles[i];
+        if (subdivide || predicted(t)) {
+            pool.submit(group, [this, t, &data, &group]{ this->border(data, t); this->split(data, t, group); },
+                (i*pool.size())/tiles.size());
+        }
+        else {
+            pool.submit(group, [this, t, &data]{ this->thread(data, t); }, (i*pool.size())/tiles.size());
+        }
+    }
+}
+
+// fills the escape buffer, tile by tile
+void FractalThread::iterate()
+{
+    TaskGroup group;
+
+    if (keepsImage()) init();
+    escape = Emap(size[X], size[Y], ssaa_dz.size());
+    subsamples = {0, (adaptive >= 0) ? 1 : ssaa_dz.size()};
+
+    std::vector<Tile> tiles = splitTiles(size, tile);
+    filled = 0;
+    submitTiles(group, escape, tiles);
+    ThreadPool::instance().wait(group);
+
+    if (adaptive >= 0) {
+        refine();
+    }
+
+    report(group, tiles.size());
+}
+
+// iterates strips of a row of tiles each, a strip is colored and its bands compressed into the PNG once its
+// tiles are done, while the strips after it are computed. Only window strips of escape data and a band
+// of colors per coloring task are held, whatever the height of the image
+void FractalThread::iterateStrips()
+{
+    constexpr size_t window = 4;
+    struct Strip {
+        Vpoint rows;
+        Emap data;
+        TaskGroup group;
+    };
+
+    ThreadPool& pool = ThreadPool::instance();
+    const size_t side = std::max<size_t>(tile, 1);
+    std::deque<Strip> strips;
+    TaskGroup all;
+    size_t count = 0;
+
+    if (keepsImage()) init();
+    subsamples = {0, ssaa_dz.size()};
+    filled = 0;
+
+    auto finish = [&]() {
+        Strip& s = strips.front();
+        pool.wait(s.group);
+        all.add(s.group);
+
+        escape = std::move(s.data);
+        colorize(s.rows);
+        escape = Emap();
+        strips.pop_front();
+    };
+
+    try {
+        for (size_t top = 0; top < size[Y]; top += side) {
+            if (strips.size() == window) finish();
+
+            Strip& s = strips.emplace_back();
+            s.rows = {top, std::min(top + side, size[Y])};
+            s.data = Emap(size[X], s.rows[Y] - s.rows[X], ssaa_dz.size(), top);
+
+            std::vector<Tile> tiles;
+            for (size_t j = 0; j < size[X]; j += side) {
+                tiles.push_back({s.rows, {j, std::min(j + side, size[X])}});
+            }
+            submitTiles(s.group, s.data, tiles);
+            count += tiles.size();
+        }
+        while (!strips.empty()) finish();
+    }
+    catch (...) {
+        // tasks of the other strips still write into them
+        for (Strip& s : strips) {
+            try { pool.wait(s.group); } catch (...) { }
+        }
+        throw;
+    }
+
+    report(all, count);
+}
+
+// what the render ran on, for whole images only
+void FractalThread::report(const TaskGroup& group, const size_t& tiles) const
+{
+    if (tiled || frames) {
+        return;
+    }
+    else if (perturbed) {
+        std::cout << "Perturbation: quad reference orbits, double deltas\n";
+    }
+    else if (simd != Simd::Mode::Off) {
+        std::cout << "SIMD: " << Simd::name(Simd::detect()) << ", " << Simd::lanes(simd) << " lanes\n";
+    }
+    else {
+        const char* names[] = {"float", "double", "long double", "quad"};
+        std::cout << "Precision: " << names[static_cast<int>(scalar)] << "\n";
+    }
+    std::cout << "Load imbalance: " << 100.0*group.imbalance() << "% (" << tiles << " tiles of " << tile << "px)\n";
+    if (adaptive >= 0) {
+        std::cout << "Adaptive: " << (100.0*refined)/(size[X]*size[Y]) << "% of the pixels supersampled\n";
+    }
+    if (subdivide) {
+        std::cout << "Subdivision: " << (100.0*filled)/(size[X]*size[Y]) << "% of the pixels filled\n";
+    }
+}
+
+// second pass of adaptive supersampling, pixels whose color is off from a neighbour's get the other samples
+void FractalThread::refine()
+{
+    std::vector<Pcolor> center(size[X]*size[Y]);
+    std::vector<char> edge(size[X]*size[Y], 0);
+    std::vector<Tile> runs;
+
+    parallelFor(size[Y], 8, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            for (size_t j = 0; j < size[X]; ++j) {
+                const Sample& c = *escape(i, j);
+                center[i*size[X] + j] = (c.iter == Sample::interior) ? base_color : palette(c.iter, c.value);
+            }
+        }
+    });
+
+    parallelFor(size[Y], 8, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            for (size_t j = 0; j < size[X]; ++j) {
+                auto neighbour = [&](const size_t& y, const size_t& x) {
+                    return differs(*escape(i, j), *escape(y, x), center[i*size[X] + j], center[y*size[X] + x]);
+                };
+                edge[i*size[X] + j] = (i > 0 && neighbour(i - 1, j)) || (i + 1 < size[Y] && neighbour(i + 1, j))
+                    || (j > 0 && neighbour(i, j - 1)) || (j + 1 < size[X] && neighbour(i, j + 1));
+            }
+        }
+    });
+
+    // consecutive edge pixels of a row go together, SIMD lanes stay busy
+    for (size_t i = 0; i < size[Y]; ++i) {
+        for (size_t j = 0; j < size[X]; ++j) {
+            if (!edge[i*size[X] + j]) continue;
+
+            size_t k = j;
+            while (k < size[X] && edge[i*size[X] + k]) ++k;
+            runs.push_back({{i, i + 1}, {j, k}});
+            j = k;
+        }
+    }
+
+    subsamples = {1, ssaa_dz.size()};
+    parallelFor(runs.size(), 16, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            thread(escape, runs[k]);
+        }
+    });
+    subsamples = {0, ssaa_dz.size()};
+
+    // the rest keep their center sample, copied so averaging and saved buffers stay uniform
+    parallelFor(size[Y], 8, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            for (size_t j = 0; j < size[X]; ++j) {
+                if (!edge[i*size[X] + j]) std::fill(escape(i, j) + 1, escape(i, j) + escape.samples(), *escape(i, j));
+            }
+        }
+    });
+
+    refined = std::count(edge.begin(), edge.end(), 1);
+}
+
+// whether neighbouring center samples a and b, colored ca and cb, need the rest of their samples
+bool FractalThread::differs(const Sample& a, const Sample& b, const Pcolor& ca, const Pcolor& cb) const
+{
+    for (size_t k = 0; k < 3; ++k) {
+        if (std::abs(ca[k] - cb[k]) > adaptive) return true;
+    }
+
+    return false;
+}
+
+// outermost rows and columns of r
+void FractalThread::border(Emap& data, const Tile& r)
+{
+    thread(data, {{r.rows[X], r.rows[X] + 1}, r.cols});
+    if (r.rows[Y] - r.rows[X] < 2) return;
+
+    thread(data, {{r.rows[Y] - 1, r.rows[Y]}, r.cols});
+    if (r.rows[Y] - r.rows[X] < 3) return;
+
+    thread(data, {{r.rows[X] + 1, r.rows[Y] - 1}, {r.cols[X], r.cols[X] + 1}});
+    if (r.cols[Y] - r.cols[X] > 1) {
+        thread(data, {{r.rows[X] + 1, r.rows[Y] - 1}, {r.cols[Y] - 1, r.cols[Y]}});
+    }
+}
+
+// Mariani-Silver: the border of r is known, a border of a single dwell is taken to enclose nothing else,
+// otherwise r is cut in four along a computed cross and the quarters go back to the pool
+void FractalThread::split(Emap& data, const Tile& r, TaskGroup& group)
+{
+    constexpr size_t min_side = 6;
+    const Tile inner = {{r.rows[X] + 1, r.rows[Y] - 1}, {r.cols[X] + 1, r.cols[Y] - 1}};
+
+    if (r.rows[Y] - r.rows[X] < 3 || r.cols[Y] - r.cols[X] < 3) {
+        return;
+    }
+    else if (r.rows[Y] - r.rows[X] <= min_side || r.cols[Y] - r.cols[X] <= min_side) {
+        thread(data, inner);
+        return;
+    }
+
+    const Sample first = *data(r.rows[X], r.cols[X]);
+    bool uniform = (subdivide == 2 || first.iter == Sample::interior);
+    auto same = [&](const size_t& i, const size_t& j) {
+        const Sample* in = data(i, j);
+        for (size_t k = subsamples[X]; k < subsamples[Y]; ++k) {
+            if (in[k].iter != first.iter) return false;
+        }
+        return true;
+    };
+
+    for (size_t j = r.cols[X]; uniform && j < r.cols[Y]; ++j) {
+        uniform = same(r.rows[X], j) && same(r.rows[Y] - 1, j);
+    }
+    for (size_t i = inner.rows[X]; uniform && i < inner.rows[Y]; ++i) {
+        uniform = same(i, r.cols[X]) && same(i, r.cols[Y] - 1);
+    }
+
+    if (uniform) {
+        for (size_t i = inner.rows[X]; i < inner.rows[Y]; ++i) {
+            for (size_t j = inner.cols[X]; j < inner.cols[Y]; ++j) {
+                std::fill(data(i, j), data(i, j) + data.samples(), first);
+            }
+        }
+        filled.fetch_add((inner.rows[Y] - inner.rows[X])*(inner.cols[Y] - inner.cols[X]), std::memory_order_relaxed);
+        return;
+    }
+
+    const size_t rm = (r.rows[X] + r.rows[Y] - 1)/2;
+    const size_t cm = (r.cols[X] + r.cols[Y] - 1)/2;
+    thread(data, {{rm, rm + 1}, inner.cols});
+    thread(data, {{inner.rows[X], rm}, {cm, cm + 1}});
+    thread(data, {{rm + 1, inner.rows[Y]}, {cm, cm + 1}});
+
+    const Tile quarters[4] = {
+        {{r.rows[X], rm + 1}, {r.cols[X], cm + 1}}, {{r.rows[X], rm + 1}, {cm, r.cols[Y]}},
+        {{rm, r.rows[Y]}, {r.cols[X], cm + 1}}, {{rm, r.rows[Y]}, {cm, r.cols[Y]}}
+    };
+    for (const Tile& q : quarters) {
+        ThreadPool::instance().submit(group, [this, &data, q, &group]{ this->split(data, q, group); });
+    }
+}
+
+void FractalThread::saveEscape(const std::string& path) const
+{
+    if (escape.samples() == 0 || tiled || frames) {
+        throw std::invalid_argument("No escape data to save for this fractal");
+    }
+
+    escape.save(path);
+}
+
+// colors a saved escape buffer with the palette of the op file, nothing is iterated
+void FractalThread::recolor(const std::string& path)
+{
+    if (tiled || frames) {
+        throw std::invalid_argument("Tiled renders and animations can not be recolored");
+    }
+
+    if (keepsImage()) init();
+    escape.load(path);
+
+    if (escape.width() != size[X] || escape.height() != size[Y] || escape.samples() != ssaa_dz.size()) {
+        throw std::invalid_argument("Escape data does not match the op file dimensions");
+    }
+
+    colorize();
     has_run = true;
 }
 
 void FractalThread::printMap()
 {
-    if (!has_run) return;
+    if (!has_run || map.height() == 0) return;
 
     for (size_t i = 0; i < size[Y]; ++i) {
         for (size_t j = 0; j < size[X]; ++j) {
-            if (map[i][j] == BLACK) putchar('*');
+            if (Pcolor(map[i][j]) == BLACK) putchar('*');
             else putchar(' ');
         }
         std::cout << "|\n";
     }
 }
 
-void FractalThread::drawImage()
+// picks the name of the image and starts the PNG, so that colorize can write rows into it
+void FractalThread::openImage()
 {
-    fs::path p{ name + ".png" };
-
-    if (fs::exists(p)) {
-        size_t i = 0;
+    const std::string ext = frames ? "_00000.png" : tiled ? "_files" : ".png";
 
-        do {
-            p = fs::path{name + "_" + std::to_string(++i) + ".png"};
-        } while(fs::exists(p));
+    if (image_name.empty()) {
+        image_name = name;
+        for (size_t i = 1; fs::exists(fs::path{image_name + ext}); ++i) {
+            image_name = name + "_" + std::to_string(i);
+        }
+    }
 
-        name = name + "_" + std::to_string(i);
+    if (!png && encoder == Encoder::Png && !tiled && !frames) {
+        png = std::make_unique<PngWriter>(image_name + ".png", size[X], size[Y]);
     }
+}
 
-    unsigned char* pix = new unsigned char[size[X]*size[Y]*3];
-    for (size_t i = 0; i < size[Y]; ++i) {
-        for(size_t j = 0; j < size[X]; ++j) {
-            pix[3*(size[X]*i + j)] = map[i][j][R];
-            pix[3*(size[X]*i + j)+1] = map[i][j][G];
-            pix[3*(size[X]*i + j)+2] = map[i][j][B];
+void FractalThread::drawImage()
+{
+    TaskGroup encoding;
+
+    drawImage(encoding);
+    ThreadPool::instance().wait(encoding);
+    closeImage();
+}
+
+// rows not streamed by colorize are compressed by the pool under encoding, closeImage finishes the image
+// once the group is done
+void FractalThread::drawImage(TaskGroup& encoding)
+{
+    openImage();
+
+    // tiles and frames are on disk already, a pyramid is described for Deep Zoom viewers
+    if (tiled || frames) {
+        if (tiled && pyramid) {
+            std::ofstream fp(image_name + ".dzi");
+            fp << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" TileSize=\"" << tiled
+                << "\" Overlap=\"0\" Format=\"png\">\n"
+                << "    <Size Width=\"" << size[X] << "\" Height=\"" << size[Y] << "\"/>\n</Image>\n";
         }
     }
+    else if (encoder == Encoder::Magick) {
+#ifdef USE_MAGICK
+        // rows are packed RGB24, the framebuffer goes to ImageMagick as is
+        Magick::Image image;
+        image.read(size[X], size[Y], "RGB", Magick::CharPixel, map.data());
+        image.write(image_name + ".png");
+#else
+        throw std::invalid_argument("Built without ImageMagick");
+#endif
+    }
+    else if (!png->complete()) {
+        encode(encoding, *png, map);
+    }
+}
 
-    Magick::Image image;
-    image.read(size[X], size[Y], "RGB", Magick::CharPixel, pix);
-    image.write(name + ".png");
-
-    if (fs::exists(fs::path{name + "_op.dat"})) {
-        fs::remove(fs::path{name + "_op.dat"});
+void FractalThread::closeImage()
+{
+    if (png) {
+        png->close();
+        png.reset();
     }
 
-    fs::copy_file(op_file, name + "_op.dat");
+    if (fs::exists(fs::path{image_name + "_op.dat"})) {
+        fs::remove(fs::path{image_name + "_op.dat"});
+    }
 
-    delete pix;
+    fs::copy_file(op_file, image_name + "_op.dat");
 }
 
 
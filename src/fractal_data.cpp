@@ -1,15 +1,26 @@
 #include "fractal_data.hpp"
 
+#include <quadmath.h>
+
 FractalType read_type(std::ifstream& fp);
 
 FThreadOpts read_main(std::ifstream& fp);
 MandelOptions read_mandel_opts(std::ifstream& fp, const bool& rc = true);
+MandelOptions read_burning_opts(std::ifstream& fp);
 BuddhaOptions read_buddha_opts(std::ifstream& fp);
 NewtonOptions read_newton_opts(std::ifstream& fp);
 
+template <typename T>
+void read_options(std::ifstream& fp, T& fOpts);
+bool read_option(std::ifstream& fp, const std::string& key, FThreadOpts& fOpts);
+bool read_option(std::ifstream& fp, const std::string& key, MandelOptions& fOpts);
+bool read_option(std::ifstream& fp, const std::string& key, BuddhaOptions& fOpts);
+bool read_option(std::ifstream& fp, const std::string& key, NewtonOptions& fOpts);
+
 Cfunction read_color_function(std::ifstream& fp);
 Cconverter read_color_converter(std::ifstream& fp);
 
+int read_exponent(const complex& n);
 Pcolor read_color(std::string color);
 u_short convert_hex(const char& c);
 
@@ -32,10 +43,10 @@ std::shared_ptr<FractalThread> read_data(const std::string& filename)
         fractal = std::shared_ptr<FractalThread>(new MandelbrotZspace(read_mandel_opts(fp)));
     }
     else if (type == FractalType::BurningCSpace) {
-        fractal = std::shared_ptr<FractalThread>(new BurningShipCspace(read_mandel_opts(fp)));
+        fractal = std::shared_ptr<FractalThread>(new BurningShipCspace(read_burning_opts(fp)));
     }
     else if (type == FractalType::BurningZSpace) {
-        fractal = std::shared_ptr<FractalThread>(new BurningShipZspace(read_mandel_opts(fp)));
+        fractal = std::shared_ptr<FractalThread>(new BurningShipZspace(read_burning_opts(fp)));
     }
     else if (type == FractalType::BuddhaCSpace) {
         fractal = std::shared_ptr<FractalThread>(new BuddhabrotCspace(read_buddha_opts(fp)));
@@ -77,11 +88,14 @@ FractalType read_type(std::ifstream& fp)
 FThreadOpts read_main(std::ifstream& fp)
 {
     FThreadOpts fOpts;
-    long double ld_aux_a, ld_aux_b, calc_aux;
+    long double calc_aux;
     size_t st_aux_a, st_aux_b;
-    std::string aux_c;
+    std::string aux_c, aux_d;
 
-    fp >> ld_aux_a >> ld_aux_b;
+    // the center is kept to quad precision for deep zooms
+    fp >> aux_c >> aux_d;
+    quad q_aux_a = strtoflt128(aux_c.c_str(), nullptr);
+    quad q_aux_b = strtoflt128(aux_d.c_str(), nullptr);
     fp >> fOpts.x_size;
     fp >> st_aux_a >> st_aux_b;
     fp >> fOpts.max_iterations;
@@ -91,7 +105,9 @@ FThreadOpts read_main(std::ifstream& fp)
     // compute size
     fOpts.size = {st_aux_a, st_aux_b};
     calc_aux = (fOpts.x_size*st_aux_b)/st_aux_a;
-    fOpts.tl_corner = {ld_aux_a - fOpts.x_size/2.0, ld_aux_b + calc_aux/2.0};
+    qcomplex tl = {q_aux_a - fOpts.x_size/2, q_aux_b + calc_aux/2};
+    fOpts.tl_corner = toComplex(tl);
+    fOpts.tl_lo = toComplex(tl - qcomplex(fOpts.tl_corner));
 
     return fOpts;
 }
@@ -104,6 +120,7 @@ MandelOptions read_mandel_opts(std::ifstream& fp, const bool& rc)
 
     fp >> aux_a >> aux_b;
     fOpts.n = {aux_a, aux_b};
+    fOpts.exponent = read_exponent(fOpts.n);
     fp >> aux_a >> aux_b;
     fOpts.c = {aux_a, aux_b};
 
@@ -111,12 +128,32 @@ MandelOptions read_mandel_opts(std::ifstream& fp, const bool& rc)
         fp >> aux_s;
         fOpts.base_color = read_color(aux_s);
         fOpts.color = read_color_function(fp);
+        read_options(fp, fOpts);
+        if (fOpts.deep && fOpts.subdivide) {
+            throw std::invalid_argument("Subdivision does not work with deep zoom");
+        }
+        // a border of one dwell only encloses that dwell for connected sets, z^n + c with a whole n
+        else if (fOpts.subdivide && fOpts.exponent < 2) {
+            throw std::invalid_argument("Subdivision needs a whole exponent n >= 2");
+        }
     }
     
 
     return fOpts;
 }
 
+// the folding of the Burning Ship gives no connected sets, subdivision could fill through its gaps
+MandelOptions read_burning_opts(std::ifstream& fp)
+{
+    MandelOptions fOpts(read_mandel_opts(fp));
+
+    if (fOpts.subdivide) {
+        throw std::invalid_argument("Subdivision does not work with the Burning Ship");
+    }
+
+    return fOpts;
+}
+
 BuddhaOptions read_buddha_opts(std::ifstream& fp)
 {
     BuddhaOptions fOpts(read_mandel_opts(fp, false));
@@ -142,6 +179,17 @@ BuddhaOptions read_buddha_opts(std::ifstream& fp)
         fOpts.color = read_color_converter(fp);
     }
 
+    // a fresh seed unless the op file fixes one, it is printed so the run can be repeated
+    std::random_device rd;
+    fOpts.rng_seed = (static_cast<uint64_t>(rd()) << 32) | rd();
+    read_options(fp, fOpts);
+
+    // Metropolis chains only depend on their first sample, split ranges have to cut between chains
+    const size_t chain = BuddhabrotBase::chain_steps;
+    if (fOpts.sampler == Sampler::Metropolis && fOpts.range[Y] != 0 && (fOpts.range[X]%chain || fOpts.range[Y]%chain)) {
+        throw std::invalid_argument("Metropolis sample ranges must be whole chains of " + std::to_string(chain) + " samples");
+    }
+
     return fOpts;
 }
 
@@ -156,19 +204,196 @@ NewtonOptions read_newton_opts(std::ifstream& fp)
     fOpts.colors.clear();
 
     fp >> n;
+    if (n == 0) {
+        throw std::invalid_argument("Newton fractals need at least one root");
+    }
     for (size_t i = 0; i < n; ++i) {
         fp >> ld_aux_a >> ld_aux_b >> c_aux;
         fOpts.roots.emplace_back(ld_aux_a, ld_aux_b);
         fOpts.colors.push_back(read_color(c_aux));
     }
     fp >> fOpts.rad_2 >> fOpts.a;
+    if (!(fOpts.rad_2 > 0 && fOpts.rad_2 < 1)) {
+        throw std::invalid_argument("The squared convergence radius must be in (0, 1)");
+    }
     fp >> c_aux;
     fOpts.base_color = read_color(c_aux);
-    fOpts.color = ColorGen::generateRootsSimple(fOpts.colors, fOpts.roots);
+    read_options(fp, fOpts);
+    if (fOpts.shading > 0) fOpts.color = ColorGen::generateRootsShaded(fOpts.colors, fOpts.shading);
+    else fOpts.color = ColorGen::generateRootsSimple(fOpts.colors);
 
     return fOpts;
 }
 
+// optional "key value" pairs after the fractal parameters, until the end of the file; older op files may
+// carry leftovers there, reading stops at the first word that is not an option
+template <typename T>
+void read_options(std::ifstream& fp, T& fOpts)
+{
+    std::string key;
+
+    while (fp >> key) {
+        if (!read_option(fp, key, fOpts)) {
+            std::cout << "Warning: ignoring the op file from \"" << key << "\" on, it is not an option\n";
+            return;
+        }
+    }
+}
+
+bool read_option(std::ifstream& fp, const std::string& key, NewtonOptions& fOpts)
+{
+    if (key == "shading") {
+        fp >> fOpts.shading;
+        if (fOpts.shading < 0) {
+            throw std::invalid_argument("Shading must not be negative");
+        }
+    }
+    else {
+        return read_option(fp, key, static_cast<FThreadOpts&>(fOpts));
+    }
+
+    return true;
+}
+
+bool read_option(std::ifstream& fp, const std::string& key, MandelOptions& fOpts)
+{
+    if (key == "deep") {
+        fp >> fOpts.deep;
+        if (fOpts.deep && fOpts.exponent != 2) {
+            throw std::invalid_argument("Deep zoom needs n = 2");
+        }
+    }
+    else if (key == "subdivide") {
+        fp >> fOpts.subdivide;
+        if (fOpts.subdivide < 0 || fOpts.subdivide > 2) {
+            throw std::invalid_argument("Unknown subdivide mode " + std::to_string(fOpts.subdivide));
+        }
+    }
+    else {
+        return read_option(fp, key, static_cast<FThreadOpts&>(fOpts));
+    }
+
+    return true;
+}
+
+bool read_option(std::ifstream& fp, const std::string& key, BuddhaOptions& fOpts)
+{
+    if (key == "sampler") {
+        std::string type;
+        fp >> type;
+        if (type == "uniform") fOpts.sampler = Sampler::Uniform;
+        else if (type == "metropolis") fOpts.sampler = Sampler::Metropolis;
+        else if (type == "grid") fOpts.sampler = Sampler::Grid;
+        else throw std::invalid_argument("Unknown sampler " + type);
+    }
+    else if (key == "seed") {
+        fp >> fOpts.rng_seed;
+    }
+    else if (key == "samples") {
+        fp >> fOpts.range[X] >> fOpts.range[Y];
+        if (fOpts.range[Y] <= fOpts.range[X]) {
+            throw std::invalid_argument("Empty sample range");
+        }
+    }
+    else if (key == "checkpoint") {
+        fp >> fOpts.checkpoint;
+    }
+    else if (key == "budget") {
+        fp >> fOpts.budget;
+    }
+    else if (key == "tiled" || key == "pyramid") {
+        throw std::invalid_argument("Buddhabrot renders need the whole histogram, they can not be tiled");
+    }
+    else if (key == "zoom") {
+        throw std::invalid_argument("Buddhabrot renders can not be animated");
+    }
+    else if (key == "histogram") {
+        std::string type;
+        fp >> type;
+        if (type == "shards") fOpts.shared = false;
+        else if (type == "shared") fOpts.shared = true;
+        else throw std::invalid_argument("Unknown histogram " + type);
+    }
+    else {
+        return read_option(fp, key, static_cast<FThreadOpts&>(fOpts));
+    }
+
+    return true;
+}
+
+bool read_option(std::ifstream& fp, const std::string& key, FThreadOpts& fOpts)
+{
+    if (key == "tile") {
+        fp >> fOpts.tile;
+    }
+    else if (key == "tiled") {
+        fp >> fOpts.tiled;
+        if (fOpts.tiled % 2) {
+            throw std::invalid_argument("Tiled renders need an even tile side");
+        }
+        else if (fOpts.tiled && fOpts.frames) {
+            throw std::invalid_argument("Zoom animations can not be tiled");
+        }
+    }
+    else if (key == "zoom") {
+        // frames, then the center and x_size of the last frame, the center to quad precision like the first
+        std::string aux_a, aux_b;
+        fp >> fOpts.frames >> aux_a >> aux_b >> fOpts.zoom_size;
+        qcomplex end = {strtoflt128(aux_a.c_str(), nullptr), strtoflt128(aux_b.c_str(), nullptr)};
+        fOpts.zoom_to = toComplex(end);
+        fOpts.zoom_to_lo = toComplex(end - qcomplex(fOpts.zoom_to));
+        if (fOpts.zoom_size <= 0) {
+            throw std::invalid_argument("The last frame of a zoom needs a positive x_size");
+        }
+        else if (fOpts.tiled && fOpts.frames) {
+            throw std::invalid_argument("Zoom animations can not be tiled");
+        }
+    }
+    else if (key == "pyramid") {
+        fp >> fOpts.pyramid;
+    }
+    else if (key == "encoder") {
+        std::string type;
+        fp >> type;
+
+        if (type == "png") fOpts.encoder = Encoder::Png;
+        else if (type == "magick") {
+#ifdef USE_MAGICK
+            fOpts.encoder = Encoder::Magick;
+#else
+            throw std::invalid_argument("Built without ImageMagick, encoder magick is not available");
+#endif
+        }
+        else throw std::invalid_argument("Unknown encoder " + type);
+    }
+    else if (key == "precision") {
+        std::string type;
+        fp >> type;
+        if (type == "float") fOpts.precision = Precision::Float;
+        else if (type == "double") fOpts.precision = Precision::Double;
+        else if (type == "long") fOpts.precision = Precision::Long;
+        else if (type == "quad") fOpts.precision = Precision::Quad;
+        else if (type == "auto") fOpts.precision = Precision::Auto;
+        else throw std::invalid_argument("Unknown precision " + type);
+    }
+    else if (key == "adaptive") {
+        fp >> fOpts.adaptive;
+    }
+    else if (key == "simd") {
+        std::string mode;
+        fp >> mode;
+        if (mode == "off") fOpts.simd = Simd::Mode::Off;
+        else if (mode == "double") fOpts.simd = Simd::Mode::Double;
+        else if (mode == "float") fOpts.simd = Simd::Mode::Float;
+        else throw std::invalid_argument("Unknown simd mode " + mode);
+    }
+    else {
+        return false;
+    }
+
+    return true;
+}
+
 
 
 
@@ -179,7 +404,7 @@ NewtonOptions read_newton_opts(std::ifstream& fp)
 Cfunction read_color_function(std::ifstream& fp)
 {
     std::string aux_type;
-    Cfunction res = [](const size_t& size, const complex& z) { return WHITE; };
+    Cfunction res = [](const size_t& size, const long double& r) { return WHITE; };
 
     fp >> aux_type;
     
@@ -228,6 +453,20 @@ Cconverter read_color_converter(std::ifstream& fp)
     return res;
 }
 
+// whole, real exponents get a specialized kernel, 0 selects the general std::pow path
+// whole real exponents that fit an int, anything else goes the general way as 0
+int read_exponent(const complex& n)
+{
+    if (std::imag(n) != 0 || std::real(n) != std::round(std::real(n))) {
+        return 0;
+    }
+    else if (std::real(n) < std::numeric_limits<int>::min() || std::real(n) > std::numeric_limits<int>::max()) {
+        return 0;
+    }
+
+    return static_cast<int>(std::real(n));
+}
+
 Pcolor read_color(std::string color)
 {
     if (color.size() != 7 && color[0] != '#') {
@@ -0,0 +1,46 @@
+#include "histogram.hpp"
+#include "scheduler.hpp"
+
+Histogram::Histogram(const size_t& width, const size_t& height, const bool& shared)
+    : w(width), h(height), tiles((width + side - 1)/side), atomic(shared),
+    counters(3*tiles*((height + side - 1)/side)*side*side, 0) { }
+
+// sum of the shards, every worker adds up its own range of tiles
+void Histogram::reduce(const std::vector<Histogram>& shards)
+{
+    constexpr size_t chunk = 3*side*side*16;
+
+    parallelFor(counters.size(), chunk, [&](size_t begin, size_t end) {
+        for (const Histogram& s : shards) {
+            const uint32_t* in = s.counters.data();
+            for (size_t k = begin; k < end; ++k) {
+                counters[k] += in[k];
+            }
+        }
+    });
+}
+
+void Histogram::copyTo(Hmap& map) const
+{
+    parallelFor(h, side, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            for (size_t j = 0; j < w; ++j) {
+                for (size_t k = 0; k < 3; ++k) {
+                    map[i][j][k] = get(i, j, k);
+                }
+            }
+        }
+    });
+}
+
+
+void Histogram::write(std::ostream& fp) const
+{
+    fp.write(reinterpret_cast<const char*>(counters.data()), counters.size()*sizeof(uint32_t));
+}
+
+// counters of a histogram of the same size
+void Histogram::read(std::istream& fp)
+{
+    fp.read(reinterpret_cast<char*>(counters.data()), counters.size()*sizeof(uint32_t));
+}
@@ -1,18 +1,148 @@
 #include "fractal_data.hpp"
 
+#include <iomanip>
+
+static void usage()
+{
+    std::cout << "Error: run program as follows:\n\n\n";
+    std::cout << "./madelbrot_exe [--save-escape | --recolor | --resume] path_to_op_file\n";
+    std::cout << "./madelbrot_exe --merge path_to_op_file histogram_files...\n";
+    std::cout << "./madelbrot_exe --batch op_files_or_directories...\n\n";
+    std::cout << "--save-escape also writes the escape data of the render to name.esc\n";
+    std::cout << "--recolor colors name.esc with the palette of the op file, without iterating\n";
+    std::cout << "--resume continues a Buddhabrot from its checkpoint name.hist\n";
+    std::cout << "--merge sums Buddhabrot histograms of the same view and colors them with the op file\n";
+    std::cout << "--batch renders every op file given, and the .dat files of every directory, in one process\n";
+    std::exit(-1);
+}
+
+// one job after the other on the same thread pool; images are streamed while they are computed, those
+// colored as a whole (Buddhabrot, ImageMagick) are encoded while the next job computes
+static int batch(const std::vector<std::string>& paths)
+{
+    using clock = std::chrono::steady_clock;
+    struct Job {
+        std::string file;
+        double seconds = 0;
+        bool failed = false;
+    };
+
+    ThreadPool& pool = ThreadPool::instance();
+    TaskGroup encoding;
+    std::shared_ptr<FractalThread> last;
+    size_t last_job = 0;
+    std::vector<Job> jobs;
+    const clock::time_point start = clock::now();
+
+    for (const std::string& path : paths) {
+        if (fs::is_directory(path)) {
+            std::vector<std::string> files;
+            for (const fs::directory_entry& entry : fs::directory_iterator(path)) {
+                if (entry.path().extension() == ".dat") files.push_back(entry.path().string());
+            }
+            std::sort(files.begin(), files.end());
+            for (const std::string& file : files) jobs.push_back({file});
+        }
+        else {
+            jobs.push_back({path});
+        }
+    }
+
+    // errors and time of finishing an image belong to the job it came from, the time is returned so the
+    // job that waited for it does not count it as well
+    auto finish = [&]() {
+        const clock::time_point begin = clock::now();
+        try {
+            pool.wait(encoding);
+            last->closeImage();
+        }
+        catch (const std::exception& e) {
+            std::cout << "Error writing the image of " << jobs[last_job].file << ": " << e.what() << "\n";
+            jobs[last_job].failed = true;
+        }
+        last.reset();
+
+        const double seconds = std::chrono::duration<double>(clock::now() - begin).count();
+        jobs[last_job].seconds += seconds;
+        return seconds;
+    };
+
+    for (size_t k = 0; k < jobs.size(); ++k) {
+        const clock::time_point begin = clock::now();
+        double finishing = 0;
+        std::cout << "\nJob " << k + 1 << "/" << jobs.size() << ": " << jobs[k].file << "\n";
+
+        try {
+            std::shared_ptr<FractalThread> f = read_data(jobs[k].file);
+            f->openImage();
+            f->run();
+            if (last) finishing = finish();
+            f->drawImage(encoding);
+            last = f;
+            last_job = k;
+        }
+        catch (const std::exception& e) {
+            std::cout << "Error: " << e.what() << "\n";
+            jobs[k].failed = true;
+        }
+        jobs[k].seconds = std::chrono::duration<double>(clock::now() - begin).count() - finishing;
+    }
+    if (last) finish();
+
+    size_t failed = 0;
+    std::cout << "\n" << std::left << std::setw(48) << "Job" << "Time\n" << std::fixed << std::setprecision(2);
+    for (const Job& job : jobs) {
+        std::cout << std::setw(48) << job.file << job.seconds << " s" << (job.failed ? "  failed" : "") << "\n";
+        failed += job.failed;
+    }
+    std::cout << jobs.size() << " jobs, " << failed << " failed, "
+        << std::chrono::duration<double>(clock::now() - start).count() << " s\n";
+
+    return failed ? 1 : 0;
+}
+
 int main(int argc, char* argv[])
 {
+#ifdef USE_MAGICK
     Magick::InitializeMagick(*argv);
+#endif
+
+    std::string flag = (argc >= 3) ? std::string(argv[1]) : "";
 
-    if (argc != 2) {
-        std::cout << "Error: run program as follows:\n\n\n";
-        std::cout << "./madelbrot_exe path_to_op_file\n";
-        std::exit(-1);
+    if (flag == "--batch") {
+        return batch(std::vector<std::string>(argv + 2, argv + argc));
     }
 
-    std::shared_ptr<FractalThread> f = read_data(std::string(argv[1]));
-    f->run();
-    f->drawImage();
+    if (argc < 2 || (flag == "--merge" && argc < 4) || (flag != "--merge" && argc > 3) ||
+        (argc == 3 && flag != "--save-escape" && flag != "--recolor" && flag != "--resume")) {
+        usage();
+    }
+
+    // the image is streamed while it is computed, an error drops the fractal and its unfinished image
+    try {
+        std::shared_ptr<FractalThread> f = read_data(std::string(argv[flag == "--merge" ? 2 : argc - 1]));
+        std::string escape = f->getName() + ".esc";
+
+        f->openImage();
+
+        if (flag == "--recolor") {
+            f->recolor(escape);
+        }
+        else if (flag == "--merge") {
+            f->merge(std::vector<std::string>(argv + 3, argv + argc));
+        }
+        else {
+            if (flag == "--resume") f->resume(f->getName() + ".hist");
+            if (flag == "--save-escape") f->keepEscape();
+            f->run();
+            if (flag == "--save-escape") f->saveEscape(escape);
+        }
+        f->drawImage();
+    }
+    catch (const std::exception& e) {
+        std::cout << "Error: " << e.what() << std::endl;
+        return 1;
+    }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,30 +1,214 @@
 #include "multibrot.hpp"
 
-void MandelbrotCspace::thread(Cmap& map, const Vpoint& ends)
-{
-    ColorGen::Vcolor color_v;
-
-    for (size_t i = ends[X]; i < ends[Y]; ++i) {
-        for (size_t j = 0; j < size[X]; ++j) {
-            complex c0_c = index2point({j,i});
-            color_v.clear();
-            for (const complex& dz : ssaa_dz) {
-                complex c0 = c0_c + dz;
-                complex z = z_seed;
-                bool non_escape = true;
+void MandelbrotCspace::render()
+{
+    if (!deep) {
+        FractalThread::render();
+        return;
+    }
+
+    // one reference serves every tile and frame: the image center, or the end of a zoom, which all of its
+    // frames look at; the ones rebased on stay with their tile
+    const qcomplex tl = qcomplex(tl_corner) + qcomplex(tl_lo);
+    auto reach = [&](const complex& offset) {
+        long double r = 0;
+        for (const complex& corner : {complex(0, 0), complex(std::real(c_vector), 0), complex(0, std::imag(c_vector)), c_vector}) {
+            r = std::max(r, std::abs(corner - offset));
+        }
+        return r + std::abs(ssaa_dz.back());
+    };
+
+    if (center.z.empty() && frames) {
+        const complex offset = toComplex(qcomplex(zoom_to) + qcomplex(zoom_to_lo) - tl);
+        reference(offset, reach(offset));
+        std::cout << "Zoom reference: " << orbit.z.size() - 1 << " iterations\n";
+    }
+    else if (center.z.empty()) {
+        const Vpoint tile_origin = origin;
+        origin = {0,0};
+        reference(Vpoint{(size1[X] + 1)/2, (size1[Y] + 1)/2}, std::abs(c_vector)/2 + std::abs(ssaa_dz.back()));
+        origin = tile_origin;
+    }
+    else if (tl != center_tl) {
+        // next frame of a zoom, the orbit stays and its series is fitted to the new view
+        center_offset = toComplex(qcomplex(center_offset) + center_tl - tl);
+        center_tl = tl;
+        center.approximate(reach(center_offset), std::abs(std::real(c_vector))/size1[X]);
+    }
+
+    if (center.z.empty()) {
+        center = orbit;
+        center_offset = ref_offset;
+        center_tl = tl;
+    }
+    orbit = center;
+    ref_offset = center_offset;
+
+    glitched.assign(size[X]*size[Y], 0);
+    iterate();
+    rebase();
+    colorize();
+}
+
+// orbit of the point offset from tl_corner in quad, with the series fitted to a disk of the given radius around it
+void MandelbrotCspace::reference(const complex& offset, const long double& radius)
+{
+    ref_offset = offset;
+    orbit = ReferenceOrbit(qcomplex(tl_corner) + qcomplex(tl_lo) + qcomplex(offset), qcomplex(z_seed), max_iterations);
+    orbit.approximate(radius, std::abs(std::real(c_vector))/size1[X]);
+}
+
+void MandelbrotCspace::reference(const Vpoint& loc, const long double& radius)
+{
+    reference(index2offset(loc), radius);
+
+    std::cout << "Reference at pixel " << loc << ": " << orbit.z.size() - 1 << " iterations, "
+        << orbit.skip << " skipped by series approximation\n";
+}
+
+// returns true when a sample glitched, the pixel is then left for the next reference
+bool MandelbrotCspace::perturb(Emap& data, const Vpoint& loc)
+{
+    Sample* out = data(loc[Y], loc[X]);
+    const complex d = index2offset(loc) - ref_offset;
+
+    for (size_t s = subsamples[X]; s < subsamples[Y]; ++s) {
+        const Complex<double> dc(d + ssaa_dz[s]);
+        const Complex<double> dc2 = dc*dc;
+        Complex<double> delta = orbit.a*dc + orbit.b*dc2 + orbit.c*dc2*dc;
+
+        out[s] = {Sample::interior, 0};
+        for (size_t k = orbit.skip; k < max_iterations; ++k) {
+            if (k + 1 >= orbit.z.size()) return true;
+
+            delta = 2.0*orbit.z[k]*delta + delta*delta + dc;
+            const Complex<double> z = orbit.z[k+1] + delta;
+            const double r = sqrMod(z);
+
+            if (r > 4) {
+                out[s] = {static_cast<uint32_t>(k), static_cast<float>(r)};
+                break;
+            }
+            else if (r < orbit.glitch[k+1]) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// new reference inside the glitched area until it is gone, leftovers are computed in quad
+void MandelbrotCspace::rebase()
+{
+    constexpr size_t max_rebase = 16;
+    std::vector<Vpoint> pixels;
+    size_t pass = 0;
+
+    for (; pass <= max_rebase; ++pass) {
+        pixels.clear();
+        for (size_t i = 0; i < size[Y]; ++i) {
+            for (size_t j = 0; j < size[X]; ++j) {
+                if (glitched[i*size[X] + j]) pixels.push_back({j,i});
+            }
+        }
+
+        if (pixels.empty()) break;
+
+        std::cout << pixels.size() << " glitched pixels\n";
+        if (pass == max_rebase) break;
+
+        // glitched pixel closest to the centroid of the glitched pixels
+        long double cx = 0, cy = 0;
+        for (const Vpoint& p : pixels) {
+            cx += p[X];
+            cy += p[Y];
+        }
+        cx /= pixels.size();
+        cy /= pixels.size();
+
+        Vpoint best = pixels[0];
+        long double radius = 0;
+        for (const Vpoint& p : pixels) {
+            if (std::hypot(p[X] - cx, p[Y] - cy) < std::hypot(best[X] - cx, best[Y] - cy)) best = p;
+        }
+        for (const Vpoint& p : pixels) {
+            radius = std::max(radius, std::abs(index2offset(p) - index2offset(best)));
+        }
+
+        reference(best, radius + std::abs(ssaa_dz.back()));
+        parallelFor(pixels.size(), 256, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                const Vpoint& p = pixels[k];
+                glitched[p[Y]*size[X] + p[X]] = perturb(escape, p);
+            }
+        });
+    }
+
+    parallelFor(pixels.size(), 16, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            const Vpoint& p = pixels[k];
+            kernel<quad, 2>(escape, {{p[Y], p[Y] + 1}, {p[X], p[X] + 1}});
+        }
+    });
+
+    if (!tiled && !frames) {
+        std::cout << "Rebases: " << pass << ", " << pixels.size() << " pixels computed in quad\n";
+    }
+}
+
+void MandelbrotCspace::thread(Emap& data, const Tile& tile)
+{
+    if (deep) {
+        for (size_t i = tile.rows[X]; i < tile.rows[Y]; ++i) {
+            for (size_t j = tile.cols[X]; j < tile.cols[Y]; ++j) {
+                if (perturb(data, {j,i})) glitched[i*size[X] + j] = 1;
+            }
+        }
+        return;
+    }
+
+    if (simd != Simd::Mode::Off && exponent == 2) {
+        vectorThread(data, tile, z_seed, false, false);
+        return;
+    }
+
+    dispatchPrecision(scalar, [&](auto T) {
+        dispatchExponent(exponent, [&](auto N){ this->kernel<typename decltype(T)::type, N>(data, tile); });
+    });
+}
+
+template <typename T, int N>
+void MandelbrotCspace::kernel(Emap& data, const Tile& tile)
+{
+    const Complex<T> n_t(n);
+    const T tol = periodTolerance<T>();
+    const bool bulbs = (N == 2) && z_seed == complex(0, 0);
+
+    for (size_t i = tile.rows[X]; i < tile.rows[Y]; ++i) {
+        for (size_t j = tile.cols[X]; j < tile.cols[Y]; ++j) {
+            Complex<T> c0_c = index2point<T>({j,i});
+            Sample* out = data(i, j);
+            for (size_t s = subsamples[X]; s < subsamples[Y]; ++s) {
+                Complex<T> c0 = c0_c + Complex<T>(ssaa_dz[s]);
+                Complex<T> z(z_seed);
+                Complex<T> saved = z;
+                out[s] = {Sample::interior, 0};
+                if (bulbs && circleCardiod(c0)) continue;
                 for (size_t k = 0; k < max_iterations; ++k) {
-                    z = std::pow(z, n) + c0;
-                    if (sqrMod(z) > 4) {
-                        non_escape = false;
-                        color_v.push_back(color(k, z));
+                    z = cpow<N>(z, n_t) + c0;
+                    const T r = sqrMod(z);
+                    if (r > 4) {
+                        out[s] = {static_cast<uint32_t>(k), static_cast<float>(r)};
                         break;
                     }
-                }
-                if (non_escape) {
-                    color_v.push_back(base_color);
+                    else if (sqrMod(Complex<T>(z - saved)) < tol) {
+                        break;
+                    }
+                    // Brent: the orbit is compared against z at the last power of two
+                    if ((k & (k + 1)) == 0) saved = z;
                 }
             }
-            map[i][j] = ColorGen::averageColor(color_v);
         }
     }
 }
@@ -34,30 +218,46 @@ void MandelbrotCspace::thread(Cmap& map, const Vpoint& ends)
 
 
 
-void MandelbrotZspace::thread(Cmap& map, const Vpoint& ends)
+void MandelbrotZspace::thread(Emap& data, const Tile& tile)
 {
-    ColorGen::Vcolor color_v;
+    if (simd != Simd::Mode::Off && exponent == 2) {
+        vectorThread(data, tile, c, true, false);
+        return;
+    }
 
-    for (size_t i = ends[X]; i < ends[Y]; ++i) {
-        for (size_t j = 0; j < size[X]; ++j) {
-            complex z_c = index2point({j,i});
-            color_v.clear();
-            for (const complex& dz : ssaa_dz) {
-                complex z = z_c + dz;
-                bool non_escape = true;
+    dispatchPrecision(scalar, [&](auto T) {
+        dispatchExponent(exponent, [&](auto N){ this->kernel<typename decltype(T)::type, N>(data, tile); });
+    });
+}
+
+template <typename T, int N>
+void MandelbrotZspace::kernel(Emap& data, const Tile& tile)
+{
+    const Complex<T> n_t(n), c_t(c);
+    const T tol = periodTolerance<T>();
+
+    for (size_t i = tile.rows[X]; i < tile.rows[Y]; ++i) {
+        for (size_t j = tile.cols[X]; j < tile.cols[Y]; ++j) {
+            Complex<T> z_c = index2point<T>({j,i});
+            Sample* out = data(i, j);
+            for (size_t s = subsamples[X]; s < subsamples[Y]; ++s) {
+                Complex<T> z = z_c + Complex<T>(ssaa_dz[s]);
+                Complex<T> saved = z;
+                out[s] = {Sample::interior, 0};
                 for (size_t k = 0; k < max_iterations; ++k) {
-                    z = std::pow(z, n) + c;
-                    if (sqrMod(z) > 4) {
-                        non_escape = false;
-                        color_v.push_back(color(k, z));
+                    z = cpow<N>(z, n_t) + c_t;
+                    const T r = sqrMod(z);
+                    if (r > 4) {
+                        out[s] = {static_cast<uint32_t>(k), static_cast<float>(r)};
                         break;
                     }
-                }
-                if (non_escape) {
-                    color_v.push_back(base_color);
+                    else if (sqrMod(Complex<T>(z - saved)) < tol) {
+                        break;
+                    }
+                    // Brent: the orbit is compared against z at the last power of two
+                    if ((k & (k + 1)) == 0) saved = z;
                 }
             }
-            map[i][j] = ColorGen::averageColor(color_v);
         }
     }
 }
\ No newline at end of file
@@ -1,37 +1,114 @@
 #include "newton.hpp"
 
-inline complex NewtonFractal::rhapson(const complex& z)
+// calls f with std::integral_constant<int, D> for the specialized degrees, D = 0 otherwise
+template <typename F>
+inline void dispatchDegree(const size_t& degree, F&& f)
 {
-    complex res = {0.0, 0.0};
+    switch (degree) {
+        case 3: f(std::integral_constant<int, 3>{}); break;
+        case 4: f(std::integral_constant<int, 4>{}); break;
+        case 5: f(std::integral_constant<int, 5>{}); break;
+        case 6: f(std::integral_constant<int, 6>{}); break;
+        case 8: f(std::integral_constant<int, 8>{}); break;
+        default: f(std::integral_constant<int, 0>{}); break;
+    }
+}
+
+// (z - r_0)...(z - r_{d-1}) multiplied out, in long double so that float kernels only round once
+Vcomplex NewtonFractal::expand(const Vcomplex& roots)
+{
+    Vcomplex c = {c_one};
 
-    for (const complex& c : roots) {
-        res += c_a/(z - c);
+    for (const complex& r : roots) {
+        c.insert(c.begin(), complex(0, 0));
+        for (size_t k = 0; k + 1 < c.size(); ++k) {
+            c[k] -= r*c[k + 1];
+        }
     }
 
-    return z - c_one/res;
+    return c;
 }
 
-inline bool NewtonFractal::checkRoot(const complex& z)
+// Newton step p(z)/p'(z), both from one Horner pass, D is the degree or 0 when only known at run time
+template <typename T, int D>
+inline Complex<T> NewtonFractal::step(const Complex<T>& z, const Complex<T>* coefs_t) const
 {
-    for (const complex& r : roots) {
-        if (sqrMod(z - r) < rad_2) return true;
+    const int d = (D != 0) ? D : static_cast<int>(coefs.size()) - 1;
+    Complex<T> p = coefs_t[d];
+    Complex<T> dp(0, 0);
+
+    for (int k = d - 1; k >= 0; --k) {
+        dp = dp*z + p;
+        p = p*z + coefs_t[k];
+    }
+
+    return p/dp;
+}
+
+template <typename T>
+inline size_t NewtonFractal::nearestRoot(const Complex<T>& z, const std::vector<Complex<T>>& roots_t) const
+{
+    size_t best = 0;
+    T dist = sqrMod(Complex<T>(z - roots_t[0]));
+
+    for (size_t i = 1; i < roots_t.size(); ++i) {
+        T d = sqrMod(Complex<T>(z - roots_t[i]));
+        if (d < dist) {
+            dist = d;
+            best = i;
+        }
     }
 
-    return false;
+    return best;
+}
+
+void NewtonFractal::thread(Emap& data, const Tile& tile)
+{
+    dispatchPrecision(scalar, [&](auto T) {
+        dispatchDegree(roots.size(), [&](auto D){ this->kernel<typename decltype(T)::type, D>(data, tile); });
+    });
+}
+
+// adaptive supersampling only goes where neighbours end on different roots or do not converge at all
+bool NewtonFractal::differs(const Sample& a, const Sample& b, const Pcolor& ca, const Pcolor& cb) const
+{
+    if ((a.iter == Sample::interior) || (b.iter == Sample::interior)) return a.iter != b.iter;
+
+    return static_cast<size_t>(a.value) != static_cast<size_t>(b.value);
 }
 
-void NewtonFractal::thread(Cmap& map, const Vpoint& ends)
+// near a simple root the Newton step is about the distance to it, so a step under rad converges and
+// the root is only looked up once. Convergence is quadratic there, log|dz|^2/log rad goes from 1 to 2
+// over one step and its log2 adds a fraction to the count for the shading, kept below the root index
+// in the value of the sample
+template <typename T, int D>
+void NewtonFractal::kernel(Emap& data, const Tile& tile)
 {
-    for (size_t i = ends[X]; i < ends[Y]; ++i) {
-        for (size_t j = 0; j < size[X]; ++j) {
-            complex z = index2point({j,i});
-            for (size_t k = 0; k < max_iterations; ++k) {
-                z = rhapson(z);
-                if (checkRoot(z)) {
-                    map[i][j] = color(k, z);
-                    break;
+    const std::vector<Complex<T>> roots_t(roots.begin(), roots.end());
+    const std::vector<Complex<T>> coefs_t(coefs.begin(), coefs.end());
+    const Complex<T> inv_a = Complex<T>(c_one)/Complex<T>(c_a);
+    const T rad = rad_2;
+    const double log_rad = std::log(static_cast<double>(rad_2));
+
+    for (size_t i = tile.rows[X]; i < tile.rows[Y]; ++i) {
+        for (size_t j = tile.cols[X]; j < tile.cols[Y]; ++j) {
+            Complex<T> z_c = index2point<T>({j,i});
+            Sample* out = data(i, j);
+            for (size_t s = subsamples[X]; s < subsamples[Y]; ++s) {
+                Complex<T> z = z_c + Complex<T>(ssaa_dz[s]);
+                out[s] = {Sample::interior, 0};
+                for (size_t k = 0; k < max_iterations; ++k) {
+                    const Complex<T> dz = step<T, D>(z, coefs_t.data());
+                    z -= dz*inv_a;
+                    const T d2 = sqrMod(dz);
+                    if (d2 < rad) {
+                        double f = 1 - std::log2(std::log(std::max(static_cast<double>(d2), 1e-300))/log_rad);
+                        f = std::clamp(f, 0.0, 0.99);
+                        out[s] = {static_cast<uint32_t>(k), static_cast<float>(nearestRoot(z, roots_t) + f)};
+                        break;
+                    }
                 }
             }
         }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,61 @@
+#include "perturbation.hpp"
+
+// Pauldelbrot criterion, |Z + dz| much smaller than |Z| means the delta lost its precision
+constexpr double glitch_tolerance = 1e-6;
+
+ReferenceOrbit::ReferenceOrbit(const qcomplex& c, const qcomplex& z_seed, const size_t& max_iterations)
+{
+    qcomplex zq = z_seed;
+
+    z.reserve(max_iterations + 1);
+    glitch.reserve(max_iterations + 1);
+    for (size_t k = 0; k <= max_iterations; ++k) {
+        Complex<double> zd(static_cast<double>(zq.real()), static_cast<double>(zq.imag()));
+        z.push_back(zd);
+        glitch.push_back(glitch_tolerance*sqrMod(zd));
+
+        if (sqrMod(zq) > 4) break;
+        zq = ipow<2>(zq) + c;
+    }
+}
+
+// skip while the series matches probes iterated exactly on the rim of the disk to a fraction of a pixel
+void ReferenceOrbit::approximate(const long double& radius, const long double& spacing)
+{
+    constexpr size_t n_probes = 8;
+    complex ak = 0, bk = 0, ck = 0;
+    std::array<complex, n_probes> dc, delta;
+
+    for (size_t p = 0; p < n_probes; ++p) {
+        dc[p] = std::polar(radius, 2*M_PIl*p/n_probes);
+        delta[p] = 0;
+    }
+
+    skip = 0;
+    for (size_t k = 0; k + 2 < z.size(); ++k) {
+        const complex zk(z[k].real(), z[k].imag());
+        complex an = 2.0L*zk*ak + 1.0L;
+        complex bn = 2.0L*zk*bk + ak*ak;
+        complex cn = 2.0L*zk*ck + 2.0L*ak*bk;
+        // no pixel of the disk may escape inside the skipped iterations
+        long double bound = (std::abs(an) + (std::abs(bn) + std::abs(cn)*radius)*radius)*radius;
+        bool valid = sqrMod(an) < 1e200 && std::abs(z[k+1]) + bound < 2;
+
+        for (size_t p = 0; p < n_probes && valid; ++p) {
+            delta[p] = 2.0L*zk*delta[p] + delta[p]*delta[p] + dc[p];
+            complex series = an*dc[p] + bn*dc[p]*dc[p] + cn*dc[p]*dc[p]*dc[p];
+            valid = std::abs(series - delta[p]) < 1e-3*std::abs(an)*spacing;
+        }
+
+        if (!valid) break;
+
+        ak = an;
+        bk = bn;
+        ck = cn;
+        skip = k + 1;
+    }
+
+    a = Complex<double>(ak);
+    b = Complex<double>(bk);
+    c = Complex<double>(ck);
+}
@@ -0,0 +1,181 @@
+#include "png.hpp"
+
+#include <zlib.h>
+
+static void put32(uint8_t* p, const uint32_t& v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+// PNG filter f of one row, prev is null for rows that may not look above
+static inline uint8_t filter(const int& f, const uint8_t* cur, const uint8_t* prev, const size_t& k)
+{
+    const int a = (k >= 3) ? cur[k - 3] : 0;
+    const int b = prev ? prev[k] : 0;
+    const int c = (prev && k >= 3) ? prev[k - 3] : 0;
+
+    switch (f) {
+        case 1: return cur[k] - a;
+        case 2: return cur[k] - b;
+        case 3: return cur[k] - (a + b)/2;
+        case 4: {
+            const int p = a + b - c;
+            const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+            return cur[k] - ((pa <= pb && pa <= pc) ? a : ((pb <= pc) ? b : c));
+        }
+        default: return cur[k];
+    }
+}
+
+PngWriter::PngWriter(const std::string& path, const size_t& width, const size_t& height, const int& level)
+    : path(path), fp(path, std::ios::out | std::ios::binary), width(width), height(height), level(level), adler(adler32(0, nullptr, 0))
+{
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    uint8_t ihdr[13] = {};
+
+    if (!fp) {
+        throw std::runtime_error("Error opening " + path);
+    }
+
+    put32(ihdr, width);
+    put32(ihdr + 4, height);
+    ihdr[8] = 8;    // bits per channel
+    ihdr[9] = 2;    // RGB
+
+    fp.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+    chunk("IHDR", ihdr, sizeof(ihdr));
+}
+
+// an image that was not finished is not left behind half written
+PngWriter::~PngWriter()
+{
+    if (!closed) {
+        fp.close();
+        std::error_code ec;
+        fs::remove(path, ec);
+    }
+}
+
+// rows [first, first + count), stride bytes apart; the filter of each row is the one with the smallest
+// sum of absolute differences, the usual heuristic
+void PngWriter::band(const size_t& first, const size_t& count, const uint8_t* rows, const size_t& stride)
+{
+    const size_t row = 3*width;
+    std::vector<uint8_t> raw(count*(row + 1));
+    Band b;
+
+    for (size_t r = 0; r < count; ++r) {
+        const uint8_t* cur = rows + r*stride;
+        const uint8_t* prev = (r > 0) ? rows + (r - 1)*stride : nullptr;
+        uint8_t* out = raw.data() + r*(row + 1);
+        size_t best_cost = std::numeric_limits<size_t>::max();
+        int best = 0;
+
+        for (int f = 0; f < (prev ? 5 : 2); ++f) {
+            size_t cost = 0;
+            for (size_t k = 0; k < row && cost < best_cost; ++k) {
+                cost += std::abs(static_cast<int8_t>(filter(f, cur, prev, k)));
+            }
+            if (cost < best_cost) {
+                best_cost = cost;
+                best = f;
+            }
+        }
+
+        out[0] = best;
+        for (size_t k = 0; k < row; ++k) {
+            out[k + 1] = filter(best, cur, prev, k);
+        }
+    }
+
+    // raw deflate, a sync flush ends non-final bands on a byte boundary so they can be concatenated
+    z_stream z = {};
+    if (deflateInit2(&z, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("Error starting deflate");
+    }
+
+    b.data.resize(deflateBound(&z, raw.size()) + 16);
+    z.next_in = raw.data();
+    z.avail_in = raw.size();
+    z.next_out = b.data.data();
+    z.avail_out = b.data.size();
+    const bool last = first + count == height;
+    const int status = deflate(&z, last ? Z_FINISH : Z_SYNC_FLUSH);
+    b.data.resize(z.total_out);
+    deflateEnd(&z);
+    if (status != (last ? Z_STREAM_END : Z_OK) || z.avail_in != 0 || z.avail_out == 0) {
+        throw std::runtime_error("Error compressing PNG rows");
+    }
+
+    b.adler = adler32(adler32(0, nullptr, 0), raw.data(), raw.size());
+    b.raw = raw.size();
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (first < next_row || pending.count(first)) {
+        throw std::logic_error("PNG rows given twice");
+    }
+    pending.emplace(first, std::move(b));
+    flush();
+}
+
+// writes the bands that now follow the written rows, the zlib header goes with the first, the checksum
+// and the end of the file after the last
+void PngWriter::flush()
+{
+    while (!pending.empty() && pending.begin()->first == next_row) {
+        Band& b = pending.begin()->second;
+
+        if (next_row == 0) {
+            b.data.insert(b.data.begin(), {0x78, 0x9C});
+        }
+        adler = adler32_combine(adler, b.adler, b.raw);
+        next_row += b.raw/(3*width + 1);
+
+        if (complete()) {
+            uint8_t sum[4];
+            put32(sum, adler);
+            b.data.insert(b.data.end(), sum, sum + 4);
+        }
+
+        chunk("IDAT", b.data.data(), b.data.size());
+        pending.erase(pending.begin());
+    }
+
+    if (complete()) {
+        chunk("IEND", nullptr, 0);
+        fp.flush();
+    }
+}
+
+void PngWriter::chunk(const char* type, const uint8_t* data, const size_t& size)
+{
+    uint8_t head[8];
+    uint8_t crc[4];
+    uLong c = crc32(0, reinterpret_cast<const Bytef*>(type), 4);
+
+    put32(head, size);
+    std::copy(type, type + 4, head + 4);
+    if (size > 0) c = crc32(c, data, size);
+    put32(crc, c);
+
+    fp.write(reinterpret_cast<const char*>(head), 8);
+    fp.write(reinterpret_cast<const char*>(data), size);
+    fp.write(reinterpret_cast<const char*>(crc), 4);
+}
+
+void PngWriter::close()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (!complete()) {
+        throw std::logic_error("PNG closed with rows missing");
+    }
+    fp.close();
+    if (!fp) {
+        throw std::runtime_error("Error writing PNG");
+    }
+    closed = true;
+}
@@ -0,0 +1,55 @@
+#include "progress.hpp"
+
+#include <iomanip>
+
+volatile std::sig_atomic_t Progress::interrupted = 0;
+
+Progress::Progress(const double& budget)
+    : budget(budget), start(std::chrono::steady_clock::now())
+{
+    interrupted = 0;
+    previous = std::signal(SIGINT, handler);
+}
+
+Progress::~Progress()
+{
+    std::signal(SIGINT, (previous == SIG_ERR) ? SIG_DFL : previous);
+}
+
+void Progress::handler(int sig)
+{
+    interrupted = 1;
+    std::signal(sig, SIG_DFL);
+}
+
+double Progress::elapsed() const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// done is the fraction of the run behind us, the ETA also stops at the budget
+void Progress::report(const size_t& samples, const size_t& hits, const double& done)
+{
+    const double t = elapsed();
+    const double rate = (t > 0) ? samples/t : 0;
+    double eta = (done > 0) ? t*(1 - done)/done : -1;
+
+    if (budget > 0) {
+        eta = (eta < 0) ? budget - t : std::min(eta, budget - t);
+    }
+
+    std::cout << "Samples: " << samples << " (" << static_cast<size_t>(rate) << "/s), hits: " << hits;
+    std::cout << ", " << std::fixed << std::setprecision(1) << 100*std::min(done, 1.0) << "%";
+    if (eta >= 0) std::cout << ", ETA " << std::setprecision(0) << std::max(eta, 0.0) << " s";
+    std::cout << std::defaultfloat << std::endl;
+}
+
+void Progress::summary(const size_t& samples, const size_t& hits) const
+{
+    const double t = elapsed();
+
+    if (cancelled()) std::cout << "Interrupted, ";
+    else if (expired()) std::cout << "Out of time, ";
+    std::cout << samples << " samples and " << hits << " hits in " << std::fixed << std::setprecision(2) << t << " s";
+    std::cout << " (" << std::setprecision(0) << ((t > 0) ? samples/t : 0) << " samples/s)" << std::defaultfloat << std::endl;
+}
@@ -0,0 +1,229 @@
+#include "scheduler.hpp"
+
+#include <chrono>
+
+//#undef Nthreads
+//#define Nthreads 1u
+
+static thread_local long worker_id = -1;
+
+TaskGroup::TaskGroup() : busy(ThreadPool::instance().size(), 0.0) { }
+
+double TaskGroup::imbalance() const
+{
+    double max = 0, mean = 0;
+
+    for (const double& b : busy) {
+        max = std::max(max, b);
+        mean += b;
+    }
+    mean /= busy.size();
+
+    return (mean > 0) ? max/mean - 1.0 : 0.0;
+}
+
+// busy times of other counted in this group too, for work spread over several groups
+void TaskGroup::add(const TaskGroup& other)
+{
+    for (size_t i = 0; i < busy.size() && i < other.busy.size(); ++i) {
+        busy[i] += other.busy[i];
+    }
+}
+
+
+
+
+
+ThreadPool& ThreadPool::instance()
+{
+    static ThreadPool pool(Nthreads);
+
+    return pool;
+}
+
+ThreadPool::ThreadPool(size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        workers.push_back(std::thread([this, i]{ this->work(i); }));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        stop = true;
+    }
+    sleep_cv.notify_all();
+
+    for (std::thread& t : workers) {
+        t.join();
+    }
+}
+
+void ThreadPool::submit(TaskGroup& group, Task task)
+{
+    // tasks spawned from a worker stay local, the rest are spread round robin
+    size_t w = (worker_id >= 0) ? worker_id : next.fetch_add(1, std::memory_order_relaxed)%size();
+
+    submit(group, std::move(task), w);
+}
+
+void ThreadPool::submit(TaskGroup& group, Task task, size_t worker)
+{
+    Queue& q = *queues[worker%size()];
+
+    group.pending.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> guard(q.lock);
+        q.jobs.push_back({&group, std::move(task)});
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        queued.fetch_add(1, std::memory_order_release);
+    }
+    sleep_cv.notify_one();
+}
+
+void ThreadPool::wait(TaskGroup& group)
+{
+    if (worker_id >= 0) {
+        // a worker never blocks, it keeps draining tasks until the group is done
+        Job job;
+        while (group.pending.load(std::memory_order_acquire) > 0) {
+            if (pop(worker_id, job)) execute(worker_id, job);
+            else std::this_thread::yield();
+        }
+        std::lock_guard<std::mutex> guard(group.lock);
+    }
+    else {
+        std::unique_lock<std::mutex> guard(group.lock);
+        group.done.wait(guard, [&]{ return group.pending.load(std::memory_order_acquire) == 0; });
+    }
+
+    if (group.error) {
+        std::exception_ptr e = group.error;
+        group.error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+// false if the group is still running after the given time, only for threads outside the pool
+bool ThreadPool::wait(TaskGroup& group, const double& seconds)
+{
+    {
+        std::unique_lock<std::mutex> guard(group.lock);
+        if (!group.done.wait_for(guard, std::chrono::duration<double>(seconds),
+            [&]{ return group.pending.load(std::memory_order_acquire) == 0; })) {
+            return false;
+        }
+    }
+
+    wait(group);
+
+    return true;
+}
+
+void ThreadPool::work(size_t id)
+{
+    Job job;
+
+    worker_id = id;
+    while (true) {
+        if (pop(id, job)) {
+            execute(id, job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(sleep_lock);
+        sleep_cv.wait(guard, [&]{ return stop || queued.load(std::memory_order_acquire) > 0; });
+        if (stop) return;
+    }
+}
+
+bool ThreadPool::pop(size_t id, Job& job)
+{
+    // own queue from the back (most recent, hot in cache), others from the front
+    {
+        Queue& q = *queues[id];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (!q.jobs.empty()) {
+            job = std::move(q.jobs.back());
+            q.jobs.pop_back();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < size(); ++i) {
+        Queue& q = *queues[(id + i)%size()];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (!q.jobs.empty()) {
+            job = std::move(q.jobs.front());
+            q.jobs.pop_front();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::execute(size_t id, Job& job)
+{
+    TaskGroup& group = *job.group;
+    auto start = std::chrono::steady_clock::now();
+
+    try {
+        job.task();
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> guard(group.lock);
+        if (!group.error) group.error = std::current_exception();
+    }
+
+    group.busy[id] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    job.task = nullptr;
+
+    // the last decrement happens under the lock so the waiter cannot destroy the group under us
+    std::lock_guard<std::mutex> guard(group.lock);
+    if (group.pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        group.done.notify_all();
+    }
+}
+
+
+
+
+
+std::vector<Tile> splitTiles(const Vpoint& size, const size_t& tile)
+{
+    std::vector<Tile> tiles;
+    size_t t = std::max<size_t>(tile, 1);
+
+    for (size_t i = 0; i < size[Y]; i += t) {
+        for (size_t j = 0; j < size[X]; j += t) {
+            tiles.push_back({{i, std::min(i + t, size[Y])}, {j, std::min(j + t, size[X])}});
+        }
+    }
+
+    return tiles;
+}
+
+// f(begin, end) over chunks of [0, count)
+void parallelFor(const size_t& count, const size_t& chunk, const std::function<void(size_t, size_t)>& f)
+{
+    ThreadPool& pool = ThreadPool::instance();
+    TaskGroup group;
+    size_t c = std::max<size_t>(chunk, 1);
+
+    for (size_t i = 0; i < count; i += c) {
+        pool.submit(group, [&f, i, c, count]{ f(i, std::min(i + c, count)); });
+    }
+    pool.wait(group);
+}
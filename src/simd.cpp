@@ -0,0 +1,159 @@
+#include "simd.hpp"
+
+#include <cstdint>
+
+namespace {
+
+    template <typename T>
+    using Int = std::conditional_t<sizeof(T) == 8, int64_t, int32_t>;
+
+    // W bytes of T per vector, lanes that finish are written back and refilled with the next sample,
+    // orbits that come back to where they were at the last power of two are cyclic (Brent)
+    template <typename T, size_t W, bool burning>
+    __attribute__((always_inline)) inline void escapeLanes(const Simd::Escape& job)
+    {
+        typedef T V __attribute__((vector_size(W)));
+        typedef Int<T> M __attribute__((vector_size(W)));
+        constexpr size_t L = W/sizeof(T);
+        constexpr Int<T> idle = std::numeric_limits<Int<T>>::min()/2;
+
+        const Int<T> max_it = static_cast<Int<T>>(job.max_iterations);
+        const T tol = periodTolerance<T>();
+        V zr = {}, zi = {}, cr = {}, ci = {}, sr = {}, si = {};
+        M k = {};
+        size_t slot[L];
+        size_t next = 0, active = 0;
+
+        auto load = [&](const size_t& l) __attribute__((always_inline)) {
+            if (next < job.count) {
+                slot[l] = next;
+                zr[l] = sr[l] = job.zr[next];
+                zi[l] = si[l] = job.zi[next];
+                cr[l] = job.cr[next];
+                ci[l] = job.ci[next];
+                k[l] = 0;
+                ++next;
+                ++active;
+            }
+            else {
+                // parked lanes iterate zero, never reach max_it and never match their saved point
+                slot[l] = job.count;
+                zr[l] = zi[l] = cr[l] = ci[l] = si[l] = 0;
+                sr[l] = 1;
+                k[l] = idle;
+            }
+        };
+
+        for (size_t l = 0; l < L; ++l) {
+            load(l);
+        }
+
+        while (active) {
+            V x2 = zr*zr;
+            V y2 = zi*zi;
+            V xy = zr*zi;
+            if constexpr (burning) {
+                xy = (xy < 0) ? -xy : xy;
+            }
+
+            zi = xy + xy + ci;
+            zr = x2 - y2 + cr;
+            k += 1;
+
+            V dr = zr - sr;
+            V di = zi - si;
+            M out = (zr*zr + zi*zi > 4);
+            M done = out | (k >= max_it) | (dr*dr + di*di < tol);
+
+            M save = ((k & (k - 1)) == 0);
+            sr = save ? zr : sr;
+            si = save ? zi : si;
+
+            Int<T> any = 0;
+            for (size_t l = 0; l < L; ++l) {
+                any |= done[l];
+            }
+            if (!any) continue;
+
+            for (size_t l = 0; l < L; ++l) {
+                if (!done[l]) continue;
+
+                const size_t s = slot[l];
+                job.iter[s] = out[l] ? static_cast<size_t>(k[l] - 1) : job.max_iterations;
+                job.fr[s] = zr[l];
+                job.fi[s] = zi[l];
+                --active;
+                load(l);
+            }
+        }
+    }
+
+    template <typename T, size_t W>
+    __attribute__((always_inline)) inline void escapeWidth(const Simd::Escape& job)
+    {
+        if (job.burning) escapeLanes<T, W, true>(job);
+        else escapeLanes<T, W, false>(job);
+    }
+
+    __attribute__((target("avx512f")))
+    void escapeAvx512(const Simd::Escape& job, const bool& single)
+    {
+        if (single) escapeWidth<float, 64>(job);
+        else escapeWidth<double, 64>(job);
+    }
+
+    __attribute__((target("avx2,fma")))
+    void escapeAvx2(const Simd::Escape& job, const bool& single)
+    {
+        if (single) escapeWidth<float, 32>(job);
+        else escapeWidth<double, 32>(job);
+    }
+
+    void escapeSse2(const Simd::Escape& job, const bool& single)
+    {
+        if (single) escapeWidth<float, 16>(job);
+        else escapeWidth<double, 16>(job);
+    }
+}
+
+namespace Simd {
+
+    Isa detect()
+    {
+        static const Isa isa = [] {
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) return Isa::Avx512;
+            else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return Isa::Avx2;
+            return Isa::Sse2;
+        }();
+
+        return isa;
+    }
+
+    std::string name(const Isa& isa)
+    {
+        switch (isa) {
+            case Isa::Avx512: return "avx512";
+            case Isa::Avx2: return "avx2";
+            default: return "sse2";
+        }
+    }
+
+    size_t lanes(const Mode& mode)
+    {
+        size_t bytes = (detect() == Isa::Avx512) ? 64 : ((detect() == Isa::Avx2) ? 32 : 16);
+
+        return (mode == Mode::Float) ? bytes/sizeof(float) : bytes/sizeof(double);
+    }
+
+    void escape(const Escape& job, const Mode& mode)
+    {
+        const bool single = (mode == Mode::Float);
+
+        switch (detect()) {
+            case Isa::Avx512: escapeAvx512(job, single); break;
+            case Isa::Avx2: escapeAvx2(job, single); break;
+            default: escapeSse2(job, single); break;
+        }
+    }
+}